@@ -0,0 +1,1112 @@
+// Measures the speed of the kernels and of whole frames without VapourSynth,
+// and checks that every instruction set gives the same output as C.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if !defined (_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "process.h"
+
+
+// The portable vector kernels are level 1 on other CPUs than x86. On x86
+// they are measured and checked as one more level, BENCH_VECTOR.
+#define BENCH_VECTOR (DECROSS_OPT_AVX512 + 1)
+
+#if defined (DECROSS_X86)
+static const char *levelNames[] = { "C", "SSE2", "AVX2", "AVX-512", "Vector" };
+#define BENCH_LAST_LEVEL BENCH_VECTOR
+#else
+static const char *levelNames[] = { "C", "Vector", "AVX2", "AVX-512" };
+#define BENCH_LAST_LEVEL DECROSS_OPT_AVX512
+#endif
+
+static const char *searchNames[] = { "full", "fast", "spatial", "temporal" };
+
+
+static int findSearch(const char *pName) {
+    for (int i = DECROSS_SEARCH_FULL; i <= DECROSS_SEARCH_TEMPORAL; i++)
+        if (!strcmp(searchNames[i], pName))
+            return i;
+
+    return -1;
+}
+
+
+// Planes laid out as in a VapourSynth frame, with no room around them but
+// what rounding the pitch up to 32 bytes leaves. Where pages can be
+// protected, each plane ends right before one that can't be read, so that
+// reading past the end of a plane crashes rather than giving every level
+// the same garbage.
+typedef struct BenchFrame {
+    uint8_t *pData[3];
+    size_t nDataSize[3];
+    uint8_t *pPlanes[3];
+    int nPitch[3];
+} BenchFrame;
+
+
+typedef struct BenchClip {
+    int nWidth;
+    int nHeight;
+    int subSamplingW;
+    int subSamplingH;
+    int nBitsPerSample;
+    std::vector<BenchFrame> frames;
+} BenchClip;
+
+
+static int planeWidth(const BenchClip *clip, int nPlane) {
+    return nPlane ? clip->nWidth >> clip->subSamplingW : clip->nWidth;
+}
+
+
+static int planeHeight(const BenchClip *clip, int nPlane) {
+    return nPlane ? clip->nHeight >> clip->subSamplingH : clip->nHeight;
+}
+
+
+static int bytesPerSample(const BenchClip *clip) {
+    return clip->nBitsPerSample > 8 ? 2 : 1;
+}
+
+
+static const char *formatName(const BenchClip *clip) {
+    if (clip->subSamplingW == 0)
+        return clip->subSamplingH ? "4:4:0" : "4:4:4";
+    if (clip->subSamplingW == 2)
+        return "4:1:1";
+
+    return clip->subSamplingH ? "4:2:0" : "4:2:2";
+}
+
+
+// The chroma pixels the filter leaves out at the start of a row, for the
+// reach of its candidates.
+static int rowBorder(const BenchClip *clip) {
+    return clip->subSamplingW ? 4 : 8;
+}
+
+
+// The end of the blocks the filter searches, which keeps the luma the
+// candidates reach inside the row.
+static int rowEnd(const BenchClip *clip) {
+    return (planeWidth(clip, 1) - SEARCH_REACH(clip->subSamplingW)) & ~3;
+}
+
+
+static BenchFrame newFrame(const BenchClip *clip) {
+    BenchFrame frame;
+
+    for (int p = 0; p < 3; p++) {
+        frame.nPitch[p] = (planeWidth(clip, p) * bytesPerSample(clip) + 31) & ~31;
+
+        const size_t nSize = (size_t)frame.nPitch[p] * planeHeight(clip, p);
+
+#if defined (_WIN32)
+        frame.nDataSize[p] = nSize;
+        frame.pData[p] = (uint8_t *)calloc(nSize, 1);
+        frame.pPlanes[p] = frame.pData[p];
+#else
+        const size_t nPage = (size_t)sysconf(_SC_PAGESIZE);
+        const size_t nPlanePages = (nSize + nPage - 1) / nPage * nPage;
+
+        frame.nDataSize[p] = nPlanePages + nPage;
+        frame.pData[p] = (uint8_t *)mmap(NULL, frame.nDataSize[p], PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (frame.pData[p] == MAP_FAILED) {
+            fprintf(stderr, "Failed to allocate a frame.\n");
+            exit(1);
+        }
+
+        mprotect(frame.pData[p] + nPlanePages, nPage, PROT_NONE);
+        frame.pPlanes[p] = frame.pData[p] + nPlanePages - nSize;
+#endif
+    }
+
+    return frame;
+}
+
+
+static void freeFrame(BenchFrame *frame) {
+    for (int p = 0; p < 3; p++) {
+#if defined (_WIN32)
+        free(frame->pData[p]);
+#else
+        munmap(frame->pData[p], frame->nDataSize[p]);
+#endif
+    }
+}
+
+
+static void freeClip(BenchClip *clip) {
+    for (size_t i = 0; i < clip->frames.size(); i++)
+        freeFrame(&clip->frames[i]);
+
+    clip->frames.clear();
+}
+
+
+static uint32_t nextRandom(uint32_t *pState) {
+    uint32_t x = *pState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *pState = x;
+}
+
+
+// Stores an 8 bit value at the clip's bit depth, with random low bits.
+static void storePixel(const BenchClip *clip, uint8_t *pRow, int x, int nValue, uint32_t *pState) {
+    if (clip->nBitsPerSample > 8) {
+        int nShift = clip->nBitsPerSample - 8;
+        ((uint16_t *)pRow)[x] = (uint16_t)((nValue << nShift) | (nextRandom(pState) & ((1 << nShift) - 1)));
+    } else {
+        pRow[x] = (uint8_t)nValue;
+    }
+}
+
+
+// Tiles of flat noise, steep ramps and coarse noise, so some rows have
+// edges and some don't. Consecutive frames are the same picture moved by a
+// pixel, with fresh noise.
+static void makeSyntheticClip(BenchClip *clip, int nFrames, uint32_t nSeed) {
+    uint32_t nState = nSeed | 1;
+
+    std::vector<uint8_t> tiles(((clip->nWidth + 2 + 15) / 16) * ((clip->nHeight + 15) / 16));
+    for (size_t i = 0; i < tiles.size(); i++)
+        tiles[i] = nextRandom(&nState) % 4;
+
+    const int nTilesPerRow = (clip->nWidth + 2 + 15) / 16;
+
+    for (int n = 0; n < nFrames; n++) {
+        BenchFrame frame = newFrame(clip);
+
+        for (int y = 0; y < clip->nHeight; y++) {
+            uint8_t *pRow = frame.pPlanes[0] + y * frame.nPitch[0];
+
+            for (int x = 0; x < clip->nWidth; x++) {
+                int tx = x + (n & 1);
+                int nNoise = nextRandom(&nState) % 4;
+                int nValue;
+
+                switch (tiles[(y / 16) * nTilesPerRow + tx / 16]) {
+                case 0:
+                    nValue = 100 + nNoise;
+                    break;
+                case 1:
+                    nValue = (tx % 16) * 15 + nNoise;
+                    break;
+                case 2:
+                    nValue = 255 - (tx % 8) * 30 - nNoise;
+                    break;
+                default:
+                    nValue = nextRandom(&nState) & 255;
+                    break;
+                }
+
+                storePixel(clip, pRow, x, nValue, &nState);
+            }
+        }
+
+        for (int p = 1; p < 3; p++)
+            for (int y = 0; y < planeHeight(clip, p); y++)
+                for (int x = 0; x < planeWidth(clip, p); x++)
+                    storePixel(clip, frame.pPlanes[p] + y * frame.nPitch[p], x, nextRandom(&nState) & 255, &nState);
+
+        clip->frames.push_back(frame);
+    }
+}
+
+
+// Raw planar YUV, one frame after another, little endian above 8 bits.
+static bool loadRawClip(BenchClip *clip, const char *pPath, int nMaxFrames) {
+    FILE *pFile = fopen(pPath, "rb");
+    if (!pFile) {
+        fprintf(stderr, "Failed to open '%s'.\n", pPath);
+        return false;
+    }
+
+    bool bComplete = true;
+
+    while ((int)clip->frames.size() < nMaxFrames && bComplete) {
+        BenchFrame frame = newFrame(clip);
+
+        for (int p = 0; p < 3 && bComplete; p++)
+            for (int y = 0; y < planeHeight(clip, p) && bComplete; y++)
+                bComplete = fread(frame.pPlanes[p] + y * frame.nPitch[p], bytesPerSample(clip), planeWidth(clip, p), pFile) == (size_t)planeWidth(clip, p);
+
+        if (bComplete) {
+            clip->frames.push_back(frame);
+        } else {
+            freeFrame(&frame);
+        }
+    }
+
+    fclose(pFile);
+
+    if (clip->frames.size() < 3) {
+        fprintf(stderr, "'%s' must have at least 3 frames of %dx%d.\n", pPath, clip->nWidth, clip->nHeight);
+        return false;
+    }
+
+    return true;
+}
+
+
+// The planes for filtering frame n, which must have neighbours, into dst,
+// if not NULL.
+static DeCrossPlanes framePlanes(const BenchClip *clip, int n, BenchFrame *dst) {
+    DeCrossPlanes planes;
+    memset(&planes, 0, sizeof(planes));
+
+    for (int fr = 0; fr < FRAME_COUNT; fr++) {
+        const BenchFrame &frame = clip->frames[n - 1 + fr];
+
+        planes.pSrc[fr] = frame.pPlanes[0];
+        planes.pSrcU[fr] = frame.pPlanes[1];
+        planes.pSrcV[fr] = frame.pPlanes[2];
+    }
+
+    planes.nNeighbours = DECROSS_NEIGHBOURS_BOTH;
+    planes.nSrcPitch = clip->frames[n].nPitch[0];
+    planes.nSrcPitchU = clip->frames[n].nPitch[1];
+
+    if (dst) {
+        planes.pDstU = dst->pPlanes[1];
+        planes.pDstV = dst->pPlanes[2];
+        planes.nDstPitchU = dst->nPitch[1];
+    }
+
+    return planes;
+}
+
+
+typedef struct BenchParams {
+    int nYThreshold;
+    int nNoiseThreshold;
+    int nMargin;
+    bool bDebug;
+    int nThreads;
+    int nSearch;
+    int nLeft;
+    int nTop;
+    int nRight;
+    int nBottom;
+    bool bAutoCrop;
+} BenchParams;
+
+
+static int initFilter(DeCrossFilter *filter, const BenchClip *clip, const BenchParams *params, int opt) {
+    memset(filter, 0, sizeof(DeCrossFilter));
+
+    filter->nYThreshold = params->nYThreshold;
+    filter->nNoiseThreshold = params->nNoiseThreshold;
+    filter->nMargin = params->nMargin;
+    filter->bDebug = params->bDebug;
+    filter->nThreads = params->nThreads;
+    filter->nSearch = params->nSearch;
+    filter->nLeft = params->nLeft;
+    filter->nTop = params->nTop;
+    filter->nRight = params->nRight;
+    filter->nBottom = params->nBottom;
+    filter->bAutoCrop = params->bAutoCrop;
+    filter->nWidth = clip->nWidth;
+    filter->nHeight = clip->nHeight;
+    filter->subSamplingW = clip->subSamplingW;
+    filter->subSamplingH = clip->subSamplingH;
+    filter->nBitsPerSample = clip->nBitsPerSample;
+
+    if (opt != BENCH_VECTOR)
+        return deCrossInitFilter(filter, opt);
+
+    deCrossInitFilter(filter, DECROSS_OPT_C);
+
+    return deCrossSelectVectorKernels(&filter->kernels, clip->nBitsPerSample, clip->subSamplingW) ? BENCH_VECTOR : DECROSS_OPT_C;
+}
+
+
+enum BenchKernel {
+    KERNEL_EDGE,
+    KERNEL_SEARCH,
+    KERNEL_AVERAGE,
+    KERNEL_FRAME,
+    KERNEL_COUNT
+};
+
+static const char *kernelNames[] = { "edge", "search", "average", "frame" };
+
+
+// Runs one kernel over every chroma row of frame n, the way the filter would
+// if every row had edges everywhere.
+static void runKernel(const DeCrossFilter *filter, const BenchClip *clip, int n, int nKernel, BenchFrame *dst, uint8_t *pEdgeBuffer, int8_t *pBest, DeCrossSharedKeys *pShared) {
+    const DeCrossKernels &k = filter->kernels;
+
+    DeCrossPlanes planes = framePlanes(clip, n, dst);
+
+    if (nKernel == KERNEL_FRAME) {
+        deCrossProcessFrame(filter, &planes, NULL);
+        return;
+    }
+
+    const int nRowSizeU = planeWidth(clip, 1);
+    const int nRows = deCrossRowEnd(filter);
+    const int nShift = clip->nBitsPerSample - 8;
+    const int nBorder = rowBorder(clip);
+    const int nXEnd = rowEnd(clip);
+
+    for (int r = 0; r < nRows; r++) {
+        const uint8_t *pLumaRows[FRAME_COUNT * LUMA_ROWS];
+
+        for (int fr = 0; fr < FRAME_COUNT; fr++)
+            for (int rr = -2; rr <= 2; rr++)
+                pLumaRows[LUMA_ROW(fr, rr)] = planes.pSrc[fr] + (2 + (r << clip->subSamplingH) + rr) * planes.nSrcPitch;
+
+        const uint8_t *pSrcU = planes.pSrcU[FRAME_CUR] + (r + 1) * planes.nSrcPitchU;
+        const uint8_t *pSrcV = planes.pSrcV[FRAME_CUR] + (r + 1) * planes.nSrcPitchU;
+
+        if (nKernel == KERNEL_EDGE) {
+            k.edgeCheck(pLumaRows[LUMA_ROW(FRAME_CUR, 0)], pEdgeBuffer, nRowSizeU, filter->nYThreshold << nShift, filter->nMargin);
+        } else if (nKernel == KERNEL_SEARCH) {
+            if (pShared)
+                pShared->nRow = r;
+            k.search(pLumaRows, r & 1 ? &filter->searchOdd[DECROSS_NEIGHBOURS_BOTH] : &filter->searchEven[DECROSS_NEIGHBOURS_BOTH], nBorder, nXEnd, nRowSizeU, filter->nNoiseThreshold << nShift, pShared, pBest);
+        } else {
+            for (int nX = nBorder; nX < nXEnd; nX += 4)
+                k.averageChroma(pSrcU, pSrcV, pSrcU - planes.nSrcPitchU, pSrcV - planes.nSrcPitchU,
+                                planes.pDstU + (r + 1) * planes.nDstPitchU, planes.pDstV + (r + 1) * planes.nDstPitchU, pEdgeBuffer, nX);
+        }
+    }
+}
+
+
+static void initSharedKeys(DeCrossSharedKeys *pShared, int nBlocks) {
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < nBlocks; j++)
+            pShared->pStamp[i][j] = -2;
+}
+
+
+// Prints the speed of every kernel at every level the CPU supports, in
+// megapixels of the whole frame per second. The best of nRuns runs over
+// nFrames frames is kept.
+static void benchClip(const BenchClip *clip, const BenchParams *params, int nFrames, int nRuns) {
+    const int nRowSizeU = planeWidth(clip, 1);
+    const int nBlocks = nRowSizeU / 4 + 8;
+
+    std::vector<uint8_t> edgeBuffer(nRowSizeU + 32, 1);
+    std::vector<int8_t> best(nBlocks);
+    std::vector<int> keys(4 * nBlocks);
+
+    DeCrossSharedKeys shared;
+    for (int i = 0; i < 2; i++) {
+        shared.pKey[i] = &keys[i * 2 * nBlocks];
+        shared.pStamp[i] = &keys[(i * 2 + 1) * nBlocks];
+    }
+
+    BenchFrame dst = newFrame(clip);
+
+    const int nClipFrames = (int)clip->frames.size();
+
+    printf("%dx%d %s %d bit, search=%s", clip->nWidth, clip->nHeight, formatName(clip), clip->nBitsPerSample, searchNames[params->nSearch]);
+    if (params->nLeft || params->nTop || params->nRight || params->nBottom)
+        printf(", crop=%d,%d,%d,%d", params->nLeft, params->nTop, params->nRight, params->nBottom);
+    if (params->bAutoCrop)
+        printf(", autocrop");
+    printf("\n");
+    printf("  %-8s", "");
+    for (int i = 0; i < KERNEL_COUNT; i++)
+        printf(" %10s", kernelNames[i]);
+    printf("   (MPix/s)\n");
+
+    for (int opt = DECROSS_OPT_C; opt <= BENCH_LAST_LEVEL; opt++) {
+        DeCrossFilter filter;
+        if (initFilter(&filter, clip, params, opt) != opt) {
+            deCrossFreeFilter(&filter);
+            continue;
+        }
+
+        printf("  %-8s", levelNames[opt]);
+
+        for (int nKernel = 0; nKernel < KERNEL_COUNT; nKernel++) {
+            double dBest = 0;
+
+            for (int nRun = 0; nRun < nRuns; nRun++) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+                for (int i = 0; i < nFrames; i++) {
+                    initSharedKeys(&shared, nBlocks);
+                    runKernel(&filter, clip, 1 + i % (nClipFrames - 2), nKernel, &dst, edgeBuffer.data(), best.data(), filter.bShareKeys ? &shared : NULL);
+                }
+
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+                dBest = std::max(dBest, (double)clip->nWidth * clip->nHeight * nFrames / elapsed.count() / 1e6);
+            }
+
+            printf(" %10.1f", dBest);
+        }
+
+        printf("\n");
+
+        deCrossFreeFilter(&filter);
+    }
+
+    freeFrame(&dst);
+}
+
+
+// Filters the middle frames of the clip at every level and compares the
+// chroma with C's. Returns the number of frames that differ.
+static int verifyFrames(const BenchClip *clip, const BenchParams *params) {
+    BenchFrame ref = newFrame(clip);
+    BenchFrame dst = newFrame(clip);
+
+    DeCrossFilter filterC;
+    initFilter(&filterC, clip, params, DECROSS_OPT_C);
+
+    int nFailures = 0;
+
+    for (int opt = DECROSS_OPT_SSE2; opt <= BENCH_LAST_LEVEL; opt++) {
+        DeCrossFilter filter;
+        if (initFilter(&filter, clip, params, opt) != opt) {
+            deCrossFreeFilter(&filter);
+            continue;
+        }
+
+        for (int n = 1; n < (int)clip->frames.size() - 1; n++) {
+            DeCrossPlanes planesC = framePlanes(clip, n, &ref);
+            DeCrossPlanes planes = framePlanes(clip, n, &dst);
+
+            // Some frames go without one or both neighbours, as at scene
+            // changes.
+            planesC.nNeighbours = DECROSS_NEIGHBOURS_BOTH - (n - 1) % DECROSS_NEIGHBOURS_COUNT;
+            planes.nNeighbours = planesC.nNeighbours;
+
+            deCrossProcessFrame(&filterC, &planesC, NULL);
+            deCrossProcessFrame(&filter, &planes, NULL);
+
+            for (int p = 1; p < 3; p++) {
+                for (int y = 0; y < planeHeight(clip, p); y++) {
+                    const uint8_t *pRef = ref.pPlanes[p] + y * ref.nPitch[p];
+                    const uint8_t *pDst = dst.pPlanes[p] + y * dst.nPitch[p];
+
+                    if (memcmp(pRef, pDst, planeWidth(clip, p) * bytesPerSample(clip)) != 0) {
+                        printf("FAIL: %s, %dx%d %s %d bit, thresholdy=%d noise=%d margin=%d debug=%d threads=%d search=%s crop=%d,%d,%d,%d autocrop=%d: frame %d, neighbours %d, plane %d, row %d differs from C.\n",
+                               levelNames[opt], clip->nWidth, clip->nHeight, formatName(clip), clip->nBitsPerSample,
+                               params->nYThreshold, params->nNoiseThreshold, params->nMargin, (int)params->bDebug, params->nThreads,
+                               searchNames[params->nSearch],
+                               params->nLeft, params->nTop, params->nRight, params->nBottom, (int)params->bAutoCrop, n, planes.nNeighbours, p, y);
+                        nFailures++;
+                        p = 3;
+                        break;
+                    }
+                }
+            }
+        }
+
+        deCrossFreeFilter(&filter);
+    }
+
+    deCrossFreeFilter(&filterC);
+
+    freeFrame(&ref);
+    freeFrame(&dst);
+
+    return nFailures;
+}
+
+
+// At every level, filters the middle frames of the clip again with the edge
+// mask of the level as the mask, which must give the same output, and
+// compares the candidate maps with C's. Returns the number of frames that
+// differ.
+static int verifyMask(const BenchClip *clip, const BenchParams *params) {
+    BenchFrame ref = newFrame(clip);
+    BenchFrame dst = newFrame(clip);
+
+    const int nRowSizeU = planeWidth(clip, 1);
+    const int nHeightU = planeHeight(clip, 1);
+
+    std::vector<uint8_t> mask(nRowSizeU * nHeightU);
+    std::vector<uint8_t> mapC(nRowSizeU * nHeightU), map(nRowSizeU * nHeightU);
+
+    DeCrossFilter filterC;
+    initFilter(&filterC, clip, params, DECROSS_OPT_C);
+
+    int nFailures = 0;
+
+    for (int opt = DECROSS_OPT_C; opt <= BENCH_LAST_LEVEL; opt++) {
+        DeCrossFilter filter;
+        if (initFilter(&filter, clip, params, opt) != opt) {
+            deCrossFreeFilter(&filter);
+            continue;
+        }
+
+        for (int n = 1; n < (int)clip->frames.size() - 1; n++) {
+            DeCrossPlanes planesRef = framePlanes(clip, n, &ref);
+            DeCrossPlanes planes = framePlanes(clip, n, &dst);
+
+            deCrossProcessFrame(&filter, &planesRef, NULL);
+
+            deCrossFindEdgeMask(&filter, planes.pSrc[FRAME_CUR], planes.nSrcPitch, mask.data(), nRowSizeU);
+            planes.pMask = mask.data();
+            planes.nMaskPitch = nRowSizeU;
+            deCrossProcessFrame(&filter, &planes, NULL);
+
+            bool bSame = true;
+            for (int p = 1; p < 3; p++)
+                for (int y = 0; y < nHeightU; y++)
+                    bSame = bSame && !memcmp(ref.pPlanes[p] + y * ref.nPitch[p], dst.pPlanes[p] + y * dst.nPitch[p], nRowSizeU * bytesPerSample(clip));
+
+            DeCrossPlanes planesMap = framePlanes(clip, n, NULL);
+            planesMap.pMap = mapC.data();
+            planesMap.nMapPitch = nRowSizeU;
+            deCrossProcessFrame(&filterC, &planesMap, NULL);
+
+            planesMap.pMap = map.data();
+            deCrossProcessFrame(&filter, &planesMap, NULL);
+
+            if (!bSame || mapC != map) {
+                printf("FAIL: %s, %dx%d %s %d bit, thresholdy=%d margin=%d search=%s: frame %d, the %s differs.\n",
+                       levelNames[opt], clip->nWidth, clip->nHeight, formatName(clip), clip->nBitsPerSample,
+                       params->nYThreshold, params->nMargin, searchNames[params->nSearch], n,
+                       bSame ? "candidate map" : "output with the mask");
+                nFailures++;
+            }
+        }
+
+        deCrossFreeFilter(&filter);
+    }
+
+    deCrossFreeFilter(&filterC);
+
+    freeFrame(&ref);
+    freeFrame(&dst);
+
+    return nFailures;
+}
+
+
+// Makes the luma outside the crop of params black in every frame, with a
+// bright pixel in the rows and columns just inside it, so that autocrop
+// finds exactly that crop.
+static void paintBorders(const BenchClip *clip, const BenchParams *params) {
+    uint32_t nState = 1;
+
+    for (size_t n = 0; n < clip->frames.size(); n++) {
+        const BenchFrame &frame = clip->frames[n];
+
+        for (int y = 0; y < clip->nHeight; y++) {
+            uint8_t *pRow = frame.pPlanes[0] + y * frame.nPitch[0];
+
+            for (int x = 0; x < clip->nWidth; x++)
+                if (y < params->nTop || y >= clip->nHeight - params->nBottom || x < params->nLeft || x >= clip->nWidth - params->nRight)
+                    storePixel(clip, pRow, x, 16, &nState);
+        }
+
+        const int nInside[4][2] = {
+            { params->nLeft, clip->nHeight / 2 },
+            { clip->nWidth - 1 - params->nRight, clip->nHeight / 2 },
+            { clip->nWidth / 2, params->nTop },
+            { clip->nWidth / 2, clip->nHeight - 1 - params->nBottom },
+        };
+
+        for (int i = 0; i < 4; i++)
+            storePixel(clip, frame.pPlanes[0] + nInside[i][1] * frame.nPitch[0], nInside[i][0], 235, &nState);
+    }
+}
+
+
+// At every level, filters the middle frames of the clip, whose borders
+// paintBorders() made black, with the crop of params and with autocrop.
+// Both must give the output without the crop for the chroma pixels whose
+// luma is inside it, rounded inwards to blocks on the left and right, and
+// the source elsewhere. Returns the number of frames that differ.
+static int verifyCrop(const BenchClip *clip, const BenchParams *params) {
+    BenchFrame ref = newFrame(clip);
+    BenchFrame dst = newFrame(clip);
+    BenchFrame autoDst = newFrame(clip);
+
+    const int nRowSizeU = planeWidth(clip, 1);
+    const int nHeightU = planeHeight(clip, 1);
+    const int nBytes = bytesPerSample(clip);
+
+    BenchParams whole = *params;
+    whole.nLeft = whole.nTop = whole.nRight = whole.nBottom = 0;
+
+    BenchParams autoCrop = whole;
+    autoCrop.bAutoCrop = true;
+
+    const int nXStart = ((((params->nLeft + (1 << clip->subSamplingW) - 1) >> clip->subSamplingW) + 3) / 4) * 4;
+    const int nXEnd = params->nRight ? (((clip->nWidth - params->nRight) >> clip->subSamplingW) / 4) * 4 : nRowSizeU;
+
+    int nFailures = 0;
+
+    for (int opt = DECROSS_OPT_C; opt <= BENCH_LAST_LEVEL; opt++) {
+        DeCrossFilter filterWhole, filter, filterAuto;
+        const int nLevels[3] = {
+            initFilter(&filterWhole, clip, &whole, opt),
+            initFilter(&filter, clip, params, opt),
+            initFilter(&filterAuto, clip, &autoCrop, opt),
+        };
+
+        for (int n = 1; n < (int)clip->frames.size() - 1 && nLevels[0] == opt; n++) {
+            DeCrossPlanes planesRef = framePlanes(clip, n, &ref);
+            DeCrossPlanes planes = framePlanes(clip, n, &dst);
+            DeCrossPlanes planesAuto = framePlanes(clip, n, &autoDst);
+
+            deCrossProcessFrame(&filterWhole, &planesRef, NULL);
+            deCrossProcessFrame(&filter, &planes, NULL);
+            deCrossProcessFrame(&filterAuto, &planesAuto, NULL);
+
+            bool bSame = true, bSameAuto = true;
+
+            for (int p = 1; p < 3; p++) {
+                for (int y = 0; y < nHeightU; y++) {
+                    const bool bRowInside = (y << clip->subSamplingH) >= params->nTop && ((y + 1) << clip->subSamplingH) <= clip->nHeight - params->nBottom;
+
+                    const uint8_t *pSrc = clip->frames[n].pPlanes[p] + y * clip->frames[n].nPitch[p];
+                    const uint8_t *pRef = ref.pPlanes[p] + y * ref.nPitch[p];
+                    const uint8_t *pDst = dst.pPlanes[p] + y * dst.nPitch[p];
+
+                    for (int x = 0; x < nRowSizeU; x++) {
+                        const uint8_t *pExpected = bRowInside && x >= nXStart && x < nXEnd ? pRef : pSrc;
+                        bSame = bSame && !memcmp(pExpected + x * nBytes, pDst + x * nBytes, nBytes);
+                    }
+
+                    bSameAuto = bSameAuto && !memcmp(pDst, autoDst.pPlanes[p] + y * autoDst.nPitch[p], nRowSizeU * nBytes);
+                }
+            }
+
+            if (!bSame || !bSameAuto) {
+                printf("FAIL: %s, %dx%d %s %d bit, thresholdy=%d margin=%d search=%s crop=%d,%d,%d,%d: frame %d, the output %s.\n",
+                       levelNames[opt], clip->nWidth, clip->nHeight, formatName(clip), clip->nBitsPerSample,
+                       params->nYThreshold, params->nMargin, searchNames[params->nSearch],
+                       params->nLeft, params->nTop, params->nRight, params->nBottom, n,
+                       bSame ? "with autocrop differs" : "doesn't match the output without the crop");
+                nFailures++;
+            }
+        }
+
+        deCrossFreeFilter(&filterWhole);
+        deCrossFreeFilter(&filter);
+        deCrossFreeFilter(&filterAuto);
+    }
+
+    freeFrame(&ref);
+    freeFrame(&dst);
+    freeFrame(&autoDst);
+
+    return nFailures;
+}
+
+
+// Calls the kernels directly, with the edge check at every nThresholdStep-th
+// threshold and every margin and the search over random spans. Returns the
+// number of differences from C.
+static int verifyKernels(const BenchClip *clip, int nThresholdStep, uint32_t nSeed) {
+    const int nRowSizeU = planeWidth(clip, 1);
+    const int nBlocks = nRowSizeU / 4 + 8;
+    const int nBytes = bytesPerSample(clip);
+    const int nShift = clip->nBitsPerSample - 8;
+    const int nBorder = rowBorder(clip);
+    const int nRowEnd = rowEnd(clip);
+
+    uint32_t nState = nSeed | 1;
+
+    BenchParams params = { 30, 60, 1, false, 1, DECROSS_SEARCH_FULL, 0, 0, 0, 0, false };
+
+    DeCrossFilter filterC;
+    initFilter(&filterC, clip, &params, DECROSS_OPT_C);
+
+    const int nRows = deCrossRowEnd(&filterC);
+
+    params.nSearch = DECROSS_SEARCH_FAST;
+
+    DeCrossFilter fast;
+    initFilter(&fast, clip, &params, DECROSS_OPT_C);
+
+    std::vector<uint8_t> edgeC(nRowSizeU + 32), edge(nRowSizeU + 32);
+    std::vector<int8_t> bestC(nBlocks), best(nBlocks);
+    std::vector<uint8_t> dstC(2 * nRowSizeU * nBytes), dst(2 * nRowSizeU * nBytes);
+
+    int nFailures = 0;
+
+    for (int opt = DECROSS_OPT_SSE2; opt <= BENCH_LAST_LEVEL; opt++) {
+        DeCrossFilter filter;
+        if (initFilter(&filter, clip, &params, opt) != opt) {
+            deCrossFreeFilter(&filter);
+            continue;
+        }
+
+        const DeCrossKernels &kC = filterC.kernels;
+        const DeCrossKernels &k = filter.kernels;
+
+        DeCrossPlanes planes = framePlanes(clip, 1, NULL);
+
+        for (int r = 0; r < nRows; r++) {
+            const uint8_t *pLumaRows[FRAME_COUNT * LUMA_ROWS];
+
+            for (int fr = 0; fr < FRAME_COUNT; fr++)
+                for (int rr = -2; rr <= 2; rr++)
+                    pLumaRows[LUMA_ROW(fr, rr)] = planes.pSrc[fr] + (2 + (r << clip->subSamplingH) + rr) * planes.nSrcPitch;
+
+            const uint8_t *pLuma = pLumaRows[LUMA_ROW(FRAME_CUR, 0)];
+
+            // Above 8 bits, the thresholds get random low bits.
+            for (int nYThreshold = 0; nYThreshold <= 255; nYThreshold += nThresholdStep) {
+                const int nScaledThreshold = (nYThreshold << nShift) | (nextRandom(&nState) & ((1 << nShift) - 1));
+
+                for (int nMargin = 0; nMargin <= 4; nMargin++) {
+                    std::fill(edgeC.begin(), edgeC.end(), 0);
+                    std::fill(edge.begin(), edge.end(), 0);
+
+                    kC.edgeCheck(pLuma, edgeC.data(), nRowSizeU, nScaledThreshold, nMargin);
+                    k.edgeCheck(pLuma, edge.data(), nRowSizeU, nScaledThreshold, nMargin);
+
+                    // Only whether the flags are 0 matters.
+                    bool bSame = true;
+                    for (size_t i = 0; i < edge.size(); i++)
+                        bSame = bSame && !edgeC[i] == !edge[i];
+
+                    if (!bSame) {
+                        printf("FAIL: %s edge check, %dx%d %d bit, row %d, thresholdy=%d margin=%d differs from C.\n",
+                               levelNames[opt], clip->nWidth, clip->nHeight, clip->nBitsPerSample, r, nScaledThreshold, nMargin);
+                        nFailures++;
+                    }
+                }
+            }
+
+            // Blocks after nXEnd may be searched too, but only those up to
+            // nXEnd are compared. The fast search is checked too, since
+            // it stops at different places in each kernel.
+            const int nNoise = nextRandom(&nState) % (256 << nShift);
+
+            for (int i = 0; i < 8 && nRowEnd > nBorder; i++) {
+                const DeCrossFilter &orders = i & 1 ? fast : filter;
+                const int nNeighbours = i < 2 ? (int)DECROSS_NEIGHBOURS_BOTH : (int)(nextRandom(&nState) % DECROSS_NEIGHBOURS_COUNT);
+                const DeCrossSearchOrder *pOrder = r & 1 ? &orders.searchOdd[nNeighbours] : &orders.searchEven[nNeighbours];
+
+                int nXStart = nBorder + (nextRandom(&nState) % ((nRowEnd - nBorder) / 4)) * 4;
+                int nXEnd = nXStart + 4 + (nextRandom(&nState) % ((nRowEnd - nXStart) / 4)) * 4;
+
+                kC.search(pLumaRows, pOrder, nXStart, nXEnd, nRowSizeU, nNoise, NULL, bestC.data());
+                k.search(pLumaRows, pOrder, nXStart, nXEnd, nRowSizeU, nNoise, NULL, best.data());
+
+                if (!std::equal(bestC.begin() + nXStart / 4, bestC.begin() + nXEnd / 4, best.begin() + nXStart / 4)) {
+                    printf("FAIL: %s search, %dx%d %d bit, row %d, blocks %d to %d, noise=%d search=%s neighbours=%d differs from C.\n",
+                           levelNames[opt], clip->nWidth, clip->nHeight, clip->nBitsPerSample, r, nXStart / 4, nXEnd / 4, nNoise, searchNames[orders.nSearch], nNeighbours);
+                    nFailures++;
+                }
+            }
+
+            for (int nX = 0; nX < nRowSizeU + 32; nX++)
+                edge[nX] = nextRandom(&nState) % 3 == 0;
+
+            const uint8_t *pSrcU = planes.pSrcU[FRAME_CUR] + (r + 1) * planes.nSrcPitchU;
+            const uint8_t *pSrcV = planes.pSrcV[FRAME_CUR] + (r + 1) * planes.nSrcPitchU;
+            const uint8_t *pMiniU = planes.pSrcU[FRAME_PREV] + r * planes.nSrcPitchU + nBytes;
+            const uint8_t *pMiniV = planes.pSrcV[FRAME_NEXT] + (r + 2) * planes.nSrcPitchU - nBytes;
+
+            std::fill(dstC.begin(), dstC.end(), 0);
+            std::fill(dst.begin(), dst.end(), 0);
+
+            for (int nX = nBorder; nX < nRowEnd; nX += 4) {
+                kC.averageChroma(pSrcU, pSrcV, pMiniU, pMiniV, dstC.data(), dstC.data() + nRowSizeU * nBytes, edge.data(), nX);
+                k.averageChroma(pSrcU, pSrcV, pMiniU, pMiniV, dst.data(), dst.data() + nRowSizeU * nBytes, edge.data(), nX);
+            }
+
+            if (dstC != dst) {
+                printf("FAIL: %s chroma average, %dx%d %d bit, row %d differs from C.\n",
+                       levelNames[opt], clip->nWidth, clip->nHeight, clip->nBitsPerSample, r);
+                nFailures++;
+            }
+        }
+
+        deCrossFreeFilter(&filter);
+    }
+
+    deCrossFreeFilter(&filterC);
+    deCrossFreeFilter(&fast);
+
+    return nFailures;
+}
+
+
+// Every level against C, over random clips of a few sizes and bit depths,
+// at every combination of thresholdy and margin and some noise values, and
+// with every search mode. Above 8 bits, the large clip and the exhaustive
+// runs are left out, and so is the large clip in 4:4:4, 4:4:0 and 4:1:1.
+static int verify(uint32_t nSeed) {
+    static const int sizes[][2] = {
+        { 96, 40 },
+        { 100, 9 },
+        { 723, 301 },
+        { 1920, 1080 },
+    };
+
+    static const int depths[] = { 8, 10, 16 };
+
+    // subSamplingW and subSamplingH.
+    static const int formats[][2] = {
+        { 1, 1 },
+        { 1, 0 },
+        { 0, 0 },
+        { 0, 1 },
+        { 2, 0 },
+    };
+
+    int nFailures = 0;
+
+    for (size_t b = 0; b < sizeof(depths) / sizeof(depths[0]); b++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+                BenchClip clip;
+                clip.nWidth = sizes[s][0];
+                clip.nHeight = sizes[s][1];
+                clip.subSamplingW = formats[f][0];
+                clip.subSamplingH = formats[f][1];
+                clip.nBitsPerSample = depths[b];
+
+                const bool bHighBits = clip.nBitsPerSample > 8;
+
+                if ((bHighBits || clip.subSamplingW != 1) && clip.nHeight >= 1000)
+                    continue;
+
+                makeSyntheticClip(&clip, 4, nSeed + (uint32_t)s);
+
+                const bool bSmall = clip.nWidth * clip.nHeight <= 96 * 40 && !bHighBits;
+
+                nFailures += verifyKernels(&clip, clip.nHeight < 1000 && !bHighBits ? 1 : 17, nSeed);
+
+                BenchParams params = { 30, 60, 1, false, 1, DECROSS_SEARCH_FULL, 0, 0, 0, 0, false };
+
+                if (bSmall) {
+                    for (params.nYThreshold = 0; params.nYThreshold <= 255; params.nYThreshold++)
+                        for (params.nMargin = 0; params.nMargin <= 4; params.nMargin++)
+                            for (params.nNoiseThreshold = 0; params.nNoiseThreshold <= 255; params.nNoiseThreshold += 51)
+                                nFailures += verifyFrames(&clip, &params);
+                } else {
+                    static const int thresholds[] = { 0, 5, 30, 100, 255 };
+
+                    for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++) {
+                        for (params.nMargin = 0; params.nMargin <= 4; params.nMargin++) {
+                            params.nYThreshold = thresholds[t];
+                            nFailures += verifyFrames(&clip, &params);
+                        }
+                    }
+                }
+
+                params.nYThreshold = 10;
+                params.nMargin = 2;
+                params.bDebug = true;
+                nFailures += verifyFrames(&clip, &params);
+
+                params.bDebug = false;
+                params.nThreads = 3;
+                nFailures += verifyFrames(&clip, &params);
+
+                params.nMargin = 4;
+                nFailures += verifyFrames(&clip, &params);
+
+                params.nMargin = 2;
+                nFailures += verifyMask(&clip, &params);
+
+                params.nYThreshold = 10;
+                params.nThreads = 1;
+
+                for (params.nSearch = DECROSS_SEARCH_FAST; params.nSearch <= DECROSS_SEARCH_TEMPORAL; params.nSearch++)
+                    for (params.nNoiseThreshold = 0; params.nNoiseThreshold <= 255; params.nNoiseThreshold += 85)
+                        nFailures += verifyFrames(&clip, &params);
+
+                // Letterbox and pillarbox bars, last since they change the
+                // clip.
+                params.nSearch = DECROSS_SEARCH_FULL;
+                params.nNoiseThreshold = 60;
+                params.nLeft = clip.nWidth / 7;
+                params.nTop = clip.nHeight / 6;
+                params.nRight = clip.nWidth / 9;
+                params.nBottom = clip.nHeight / 5;
+                paintBorders(&clip, &params);
+
+                nFailures += verifyCrop(&clip, &params);
+                nFailures += verifyFrames(&clip, &params);
+                nFailures += verifyMask(&clip, &params);
+
+                params.nThreads = 3;
+                nFailures += verifyCrop(&clip, &params);
+
+                params.nLeft = params.nTop = params.nRight = params.nBottom = 0;
+                params.bAutoCrop = true;
+                nFailures += verifyFrames(&clip, &params);
+
+                freeClip(&clip);
+            }
+        }
+    }
+
+    for (int opt = DECROSS_OPT_SSE2; opt <= DECROSS_OPT_AVX512; opt++) {
+        DeCrossKernels kernels;
+        if (deCrossSelectKernels(&kernels, opt, 8, 1) != opt)
+            printf("%s is not supported by this CPU and was not checked.\n", levelNames[opt]);
+    }
+
+    DeCrossKernels kernels;
+    if (!deCrossSelectVectorKernels(&kernels, 8, 1))
+        printf("The vector kernels need GCC 9 or Clang and were not checked.\n");
+
+    if (nFailures)
+        printf("%d failures.\n", nFailures);
+    else
+        printf("All levels give the same output as C.\n");
+
+    return nFailures ? 1 : 0;
+}
+
+
+static void usage() {
+    fprintf(stderr,
+            "Usage: decross-bench [options]\n"
+            "\n"
+            "  --verify              Check that every instruction set gives the same output as C\n"
+            "  --size WxH            Frame size to measure, may be repeated (default: 720x480, 1920x1080, 3840x2160)\n"
+            "  --format F            Chroma subsampling, 444, 440, 422, 420 or 411, may be repeated (default: 420 and 422)\n"
+            "  --bits N              Bits per sample, 8 to 16 (default: 8)\n"
+            "  --input FILE          Raw planar YUV to measure instead of synthetic frames, needs one --size and --format\n"
+            "  --frames N            Frames per run (default: 30)\n"
+            "  --runs N              Runs, of which the fastest is reported (default: 5)\n"
+            "  --thresholdy N        (default: 30)\n"
+            "  --noise N             (default: 60)\n"
+            "  --margin N            (default: 1)\n"
+            "  --threads N           (default: 1)\n"
+            "  --search MODE         full, fast, spatial or temporal (default: full)\n"
+            "  --crop L,T,R,B        Luma pixels left out on each side (default: 0,0,0,0)\n"
+            "  --autocrop            Leave out the black borders of each frame too\n"
+            "  --seed N              Seed of the synthetic frames (default: 1)\n");
+}
+
+
+int main(int argc, char **argv) {
+    BenchParams params = { 30, 60, 1, false, 1, DECROSS_SEARCH_FULL, 0, 0, 0, 0, false };
+
+    std::vector<std::pair<int, int> > sizes;
+    std::vector<int> formats;
+    const char *pInput = NULL;
+    bool bVerify = false;
+    int nFrames = 30;
+    int nRuns = 5;
+    int nBitsPerSample = 8;
+    uint32_t nSeed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const char *pArg = argv[i];
+        const char *pValue = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (!strcmp(pArg, "--verify")) {
+            bVerify = true;
+            continue;
+        }
+
+        if (!strcmp(pArg, "--autocrop")) {
+            params.bAutoCrop = true;
+            continue;
+        }
+
+        if (!pValue) {
+            usage();
+            return 1;
+        }
+
+        i++;
+
+        int w, h;
+        int l, t, r, b;
+
+        if (!strcmp(pArg, "--size") && sscanf(pValue, "%dx%d", &w, &h) == 2 && w >= 8 && h >= 8) {
+            sizes.push_back(std::make_pair(w, h));
+        } else if (!strcmp(pArg, "--format") && (!strcmp(pValue, "444") || !strcmp(pValue, "440") || !strcmp(pValue, "422") || !strcmp(pValue, "420") || !strcmp(pValue, "411"))) {
+            formats.push_back(atoi(pValue));
+        } else if (!strcmp(pArg, "--bits") && atoi(pValue) >= 8 && atoi(pValue) <= 16) {
+            nBitsPerSample = atoi(pValue);
+        } else if (!strcmp(pArg, "--input")) {
+            pInput = pValue;
+        } else if (!strcmp(pArg, "--frames")) {
+            nFrames = std::max(atoi(pValue), 1);
+        } else if (!strcmp(pArg, "--runs")) {
+            nRuns = std::max(atoi(pValue), 1);
+        } else if (!strcmp(pArg, "--thresholdy")) {
+            params.nYThreshold = std::min(std::max(atoi(pValue), 0), 255);
+        } else if (!strcmp(pArg, "--noise")) {
+            params.nNoiseThreshold = std::min(std::max(atoi(pValue), 0), 255);
+        } else if (!strcmp(pArg, "--margin")) {
+            params.nMargin = std::min(std::max(atoi(pValue), 0), 4);
+        } else if (!strcmp(pArg, "--threads")) {
+            params.nThreads = std::min(std::max(atoi(pValue), 0), 64);
+        } else if (!strcmp(pArg, "--crop") && sscanf(pValue, "%d,%d,%d,%d", &l, &t, &r, &b) == 4 && std::min(std::min(l, t), std::min(r, b)) >= 0) {
+            params.nLeft = l;
+            params.nTop = t;
+            params.nRight = r;
+            params.nBottom = b;
+        } else if (!strcmp(pArg, "--search") && findSearch(pValue) >= 0) {
+            params.nSearch = findSearch(pValue);
+        } else if (!strcmp(pArg, "--seed")) {
+            nSeed = (uint32_t)strtoul(pValue, NULL, 10);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (bVerify)
+        return verify(nSeed);
+
+    if (sizes.empty()) {
+        sizes.push_back(std::make_pair(720, 480));
+        sizes.push_back(std::make_pair(1920, 1080));
+        sizes.push_back(std::make_pair(3840, 2160));
+    }
+
+    if (formats.empty()) {
+        formats.push_back(420);
+        formats.push_back(422);
+    }
+
+    if (pInput && (sizes.size() != 1 || formats.size() != 1)) {
+        usage();
+        return 1;
+    }
+
+    for (size_t s = 0; s < sizes.size(); s++) {
+        for (size_t f = 0; f < formats.size(); f++) {
+            BenchClip clip;
+            clip.nWidth = sizes[s].first;
+            clip.nHeight = sizes[s].second;
+            clip.subSamplingW = formats[f] == 444 || formats[f] == 440 ? 0 : formats[f] == 411 ? 2 : 1;
+            clip.subSamplingH = formats[f] == 420 || formats[f] == 440;
+            clip.nBitsPerSample = nBitsPerSample;
+
+            if (pInput) {
+                if (!loadRawClip(&clip, pInput, nFrames + 2)) {
+                    freeClip(&clip);
+                    return 1;
+                }
+            } else {
+                makeSyntheticClip(&clip, 5, nSeed);
+            }
+
+            benchClip(&clip, &params, nFrames, nRuns);
+
+            freeClip(&clip);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "cpu.h"
+
+#if defined (DECROSS_X86)
+#if defined (_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+
+#if defined (DECROSS_X86)
+
+static void deCrossCPUID(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#if defined (_MSC_VER)
+    int r[4];
+    __cpuidex(r, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; i++)
+        regs[i] = (uint32_t)r[i];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+
+static uint64_t deCrossXGETBV(uint32_t index) {
+#if defined (_MSC_VER)
+    return _xgetbv(index);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+#endif
+
+
+uint32_t deCrossGetCPUFeatures() {
+    uint32_t features = 0;
+
+#if defined (DECROSS_X86)
+    uint32_t regs[4];
+
+    deCrossCPUID(0, 0, regs);
+    uint32_t max_leaf = regs[0];
+
+    if (max_leaf < 1)
+        return features;
+
+    deCrossCPUID(1, 0, regs);
+    uint32_t ecx1 = regs[2];
+    uint32_t edx1 = regs[3];
+
+    if (edx1 & (1 << 26))
+        features |= DECROSS_CPU_SSE2;
+
+    bool osxsave = ecx1 & (1 << 27);
+    bool avx = ecx1 & (1 << 28);
+
+    if (!osxsave || !avx || max_leaf < 7)
+        return features;
+
+    uint64_t xcr0 = deCrossXGETBV(0);
+
+    // XMM and YMM state.
+    if ((xcr0 & 0x6) != 0x6)
+        return features;
+
+    deCrossCPUID(7, 0, regs);
+    uint32_t ebx7 = regs[1];
+
+    if (ebx7 & (1 << 5))
+        features |= DECROSS_CPU_AVX2;
+
+    // Opmask, upper ZMM0-15, and ZMM16-31 state.
+    if ((xcr0 & 0xe6) == 0xe6 &&
+        (features & DECROSS_CPU_AVX2) &&
+        (ebx7 & (1 << 16)) &&
+        (ebx7 & (1u << 30)))
+        features |= DECROSS_CPU_AVX512;
+#endif
+
+    return features;
+}
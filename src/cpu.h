@@ -0,0 +1,18 @@
+#ifndef DECROSS_CPU_H
+#define DECROSS_CPU_H
+
+#include <cstdint>
+
+
+enum DeCrossCPUFeatures {
+    DECROSS_CPU_SSE2 = 1 << 0,
+    DECROSS_CPU_AVX2 = 1 << 1,
+    DECROSS_CPU_AVX512 = 1 << 2, // AVX-512 F and BW
+};
+
+
+// Returns a combination of DeCrossCPUFeatures. Only features the operating
+// system saves the registers for are reported.
+uint32_t deCrossGetCPUFeatures();
+
+#endif // DECROSS_CPU_H
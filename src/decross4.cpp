@@ -0,0 +1,319 @@
+// The same filters for VapourSynth API v4, which cores from R55 on load
+// instead of the v3 ones in decross.cpp. Both make their frames with
+// plugin.h. Unlike v3, the filters tell the core which frames of each clip
+// they request.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <VapourSynth4.h>
+
+#include "plugin.h"
+
+
+typedef DeCrossInstance<VSNode, VSVideoInfo> DeCrossData;
+
+
+// The calls of plugin.h, in API v4.
+struct DeCrossApi4 {
+    typedef VSFrame Frame;
+
+    VSFrameContext *frameCtx;
+    VSCore *core;
+    const VSAPI *vsapi;
+
+    void requestFrame(int n, VSNode *node) const {
+        vsapi->requestFrameFilter(n, node, frameCtx);
+    }
+
+    const VSFrame *getFrame(int n, VSNode *node) const {
+        return vsapi->getFrameFilter(n, node, frameCtx);
+    }
+
+    void freeFrame(const VSFrame *f) const {
+        vsapi->freeFrame(f);
+    }
+
+    const uint8_t *getReadPtr(const VSFrame *f, int plane) const {
+        return vsapi->getReadPtr(f, plane);
+    }
+
+    uint8_t *getWritePtr(VSFrame *f, int plane) const {
+        return vsapi->getWritePtr(f, plane);
+    }
+
+    int getStride(const VSFrame *f, int plane) const {
+        return (int)vsapi->getStride(f, plane);
+    }
+
+    VSFrame *newFrame(const VSVideoInfo *vi, const VSFrame *src) const {
+        return vsapi->newVideoFrame(&vi->format, vi->width, vi->height, src, core);
+    }
+
+    VSFrame *newLumaFrame(const VSVideoInfo *vi, const VSFrame *src) const {
+        const VSFrame *planeSrc[3] = { src, NULL, NULL };
+        const int planes[3] = { 0, 0, 0 };
+
+        return vsapi->newVideoFrame2(&vi->format, vi->width, vi->height, planeSrc, planes, src, core);
+    }
+
+    VSFrame *copyFrame(const VSFrame *src) const {
+        return vsapi->copyFrame(src, core);
+    }
+
+    int64_t getInt(const VSFrame *f, const char *name) const {
+        int err;
+        return vsapi->mapGetInt(vsapi->getFramePropertiesRO(f), name, 0, &err);
+    }
+
+    void setIntArray(VSFrame *f, const char *name, const int64_t *values, int size) const {
+        vsapi->mapSetIntArray(vsapi->getFramePropertiesRW(f), name, values, size);
+    }
+};
+
+
+static const VSFrame *VS_CC deCrossGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    const DeCrossData *d = (const DeCrossData *)instanceData;
+    const DeCrossApi4 api = { frameCtx, core, vsapi };
+
+    if (activationReason == arInitial)
+        deCrossRequestFrames(api, d, n);
+    else if (activationReason == arAllFramesReady)
+        return deCrossMakeFrame(api, d, n, frameData);
+    else if (activationReason == arError)
+        deCrossAbandonFrame(api, d, frameData);
+
+    return NULL;
+}
+
+
+static void VS_CC deCrossFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
+    (void)core;
+
+    DeCrossData *d = (DeCrossData *)instanceData;
+
+    vsapi->freeNode(d->clip);
+    vsapi->freeNode(d->scenes);
+    vsapi->freeNode(d->mask);
+
+    deCrossFreeFilter(&d->filter);
+
+    free(d);
+}
+
+
+static void deCrossSetError(VSMap *out, const char *name, const char *message, const VSAPI *vsapi) {
+    char error[256];
+    snprintf(error, sizeof(error), "%s: %s", name, message);
+    vsapi->mapSetError(out, error);
+}
+
+
+// Clips read only at the frame being made. Strictly spatial also tells
+// the core that the numbers of frames match, which mask and scenes only
+// need to be at least.
+static int deCrossSpatialPattern(const DeCrossData *d, VSNode *node, const VSAPI *vsapi) {
+    return vsapi->getVideoInfo(node)->numFrames == d->vi->numFrames ? rpStrictSpatial : rpNoFrameReuse;
+}
+
+
+// DeCross and Mask. userData is the DeCrossOutput.
+static void VS_CC deCrossCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    DeCrossData d;
+    memset(&d, 0, sizeof(d));
+
+    d.nOutput = (int)(intptr_t)userData;
+
+    const char *name = d.nOutput == DECROSS_OUTPUT_CLIP ? "DeCross" : "Mask";
+
+    int err;
+
+    d.filter.nYThreshold = vsapi->mapGetIntSaturated(in, "thresholdy", 0, &err);
+    if (err)
+        d.filter.nYThreshold = 30;
+
+    d.filter.nNoiseThreshold = vsapi->mapGetIntSaturated(in, "noise", 0, &err);
+    if (err)
+        d.filter.nNoiseThreshold = 60;
+
+    d.filter.nMargin = vsapi->mapGetIntSaturated(in, "margin", 0, &err);
+    if (err)
+        d.filter.nMargin = 1;
+
+    d.filter.bDebug = !!vsapi->mapGetInt(in, "debug", 0, &err);
+
+    int opt = vsapi->mapGetIntSaturated(in, "opt", 0, &err);
+    if (err)
+        opt = DECROSS_OPT_AVX512;
+
+    d.filter.nThreads = vsapi->mapGetIntSaturated(in, "threads", 0, &err);
+    if (err)
+        d.filter.nThreads = 1;
+
+    d.filter.bStats = !!vsapi->mapGetInt(in, "stats", 0, &err);
+
+    const char *search = vsapi->mapGetData(in, "search", 0, &err);
+    if (err)
+        search = "full";
+
+    d.filter.nLeft = vsapi->mapGetIntSaturated(in, "left", 0, &err);
+    d.filter.nTop = vsapi->mapGetIntSaturated(in, "top", 0, &err);
+    d.filter.nRight = vsapi->mapGetIntSaturated(in, "right", 0, &err);
+    d.filter.nBottom = vsapi->mapGetIntSaturated(in, "bottom", 0, &err);
+
+    d.filter.bAutoCrop = !!vsapi->mapGetInt(in, "autocrop", 0, &err);
+
+    if (d.nOutput == DECROSS_OUTPUT_EDGES && vsapi->mapGetInt(in, "candidates", 0, &err))
+        d.nOutput = DECROSS_OUTPUT_CANDIDATES;
+
+
+    const char *error = deCrossCheckParams(&d.filter, opt, search);
+    if (error) {
+        deCrossSetError(out, name, error, vsapi);
+        return;
+    }
+
+    d.clip = vsapi->mapGetNode(in, "clip", 0, NULL);
+    d.vi = vsapi->getVideoInfo(d.clip);
+
+    if (d.vi->format.colorFamily != cfYUV ||
+        d.vi->format.sampleType != stInteger ||
+        d.vi->format.bitsPerSample > 16 ||
+        d.vi->format.subSamplingW > 2 ||
+        d.vi->format.subSamplingH > 1 ||
+        (d.vi->format.subSamplingW == 2 && d.vi->format.subSamplingH == 1) ||
+        d.vi->width == 0 ||
+        d.vi->height == 0) {
+        deCrossSetError(out, name, "only 8 to 16 bit integer YUV444P, YUV422P, YUV420P, YUV411P and YUV440P with constant format and dimensions supported.", vsapi);
+        vsapi->freeNode(d.clip);
+        return;
+    }
+
+    d.scenes = vsapi->mapGetNode(in, "scenes", 0, &err);
+
+    if (d.scenes && vsapi->getVideoInfo(d.scenes)->numFrames < d.vi->numFrames) {
+        deCrossSetError(out, name, "scenes must have at least as many frames as clip.", vsapi);
+        vsapi->freeNode(d.scenes);
+        vsapi->freeNode(d.clip);
+        return;
+    }
+
+    d.viOut = *d.vi;
+
+    if (d.nOutput != DECROSS_OUTPUT_CLIP) {
+        vsapi->queryVideoFormat(&d.viOut.format, cfGray, stInteger, 8, 0, 0, core);
+        d.viOut.width = d.vi->width >> d.vi->format.subSamplingW;
+        d.viOut.height = d.vi->height >> d.vi->format.subSamplingH;
+    }
+
+    d.mask = vsapi->mapGetNode(in, "mask", 0, &err);
+
+    if (d.mask) {
+        const VSVideoInfo *viMask = vsapi->getVideoInfo(d.mask);
+
+        if (d.nOutput == DECROSS_OUTPUT_EDGES) {
+            deCrossSetError(out, name, "mask can only be given with candidates=True.", vsapi);
+            vsapi->freeNode(d.mask);
+            vsapi->freeNode(d.scenes);
+            vsapi->freeNode(d.clip);
+            return;
+        }
+
+        if (viMask->format.colorFamily != cfGray ||
+            viMask->format.sampleType != stInteger ||
+            viMask->format.bitsPerSample != 8 ||
+            viMask->width != d.vi->width >> d.vi->format.subSamplingW ||
+            viMask->height != d.vi->height >> d.vi->format.subSamplingH ||
+            viMask->numFrames < d.vi->numFrames) {
+            deCrossSetError(out, name, "mask must be GRAY8 with the dimensions of the chroma of clip and at least as many frames.", vsapi);
+            vsapi->freeNode(d.mask);
+            vsapi->freeNode(d.scenes);
+            vsapi->freeNode(d.clip);
+            return;
+        }
+    }
+
+
+    d.filter.nWidth = d.vi->width;
+    d.filter.nHeight = d.vi->height;
+    d.filter.subSamplingW = d.vi->format.subSamplingW;
+    d.filter.subSamplingH = d.vi->format.subSamplingH;
+    d.filter.nBitsPerSample = d.vi->format.bitsPerSample;
+
+    deCrossInitFilter(&d.filter, opt);
+
+
+    // The clip is read at n - 1 and n + 1 too, by DeCross and the
+    // candidate map, unless only the current frame is searched. Declaring
+    // that lets the core keep the clip's frames cached for the neighbours
+    // and skip caching the clips read only once.
+    VSFilterDependency deps[3];
+    int nDeps = 0;
+
+    const bool bNeighbours = d.filter.bNeighbours && d.nOutput != DECROSS_OUTPUT_EDGES;
+
+    deps[nDeps].source = d.clip;
+    deps[nDeps++].requestPattern = bNeighbours ? rpGeneral : rpStrictSpatial;
+
+    if (d.scenes) {
+        deps[nDeps].source = d.scenes;
+        deps[nDeps++].requestPattern = deCrossSpatialPattern(&d, d.scenes, vsapi);
+    }
+
+    if (d.mask) {
+        deps[nDeps].source = d.mask;
+        deps[nDeps++].requestPattern = deCrossSpatialPattern(&d, d.mask, vsapi);
+    }
+
+    DeCrossData *data = (DeCrossData *)malloc(sizeof(d));
+    *data = d;
+
+    // Not a linear filter: setLinearFilter() is for filters that must make
+    // their frames in order, like source filters, and would stop the frames
+    // from being made in parallel.
+    vsapi->createVideoFilter(out, name, &data->viOut, deCrossGetFrame, deCrossFree, fmParallel, deps, nDeps, data, core);
+}
+
+
+VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
+    vspapi->configPlugin("com.nodame.decross", "decross", "Spatio-temporal derainbow filter", VS_MAKE_VERSION(2, 0), VAPOURSYNTH_API_VERSION, 0, plugin);
+    vspapi->registerFunction("DeCross",
+                             "clip:vnode;"
+                             "thresholdy:int:opt;"
+                             "noise:int:opt;"
+                             "margin:int:opt;"
+                             "debug:int:opt;"
+                             "opt:int:opt;"
+                             "threads:int:opt;"
+                             "stats:int:opt;"
+                             "search:data:opt;"
+                             "scenes:vnode:opt;"
+                             "mask:vnode:opt;"
+                             "left:int:opt;"
+                             "top:int:opt;"
+                             "right:int:opt;"
+                             "bottom:int:opt;"
+                             "autocrop:int:opt;",
+                             "clip:vnode;",
+                             deCrossCreate, (void *)DECROSS_OUTPUT_CLIP, plugin);
+    vspapi->registerFunction("Mask",
+                             "clip:vnode;"
+                             "candidates:int:opt;"
+                             "thresholdy:int:opt;"
+                             "noise:int:opt;"
+                             "margin:int:opt;"
+                             "opt:int:opt;"
+                             "threads:int:opt;"
+                             "search:data:opt;"
+                             "scenes:vnode:opt;"
+                             "mask:vnode:opt;"
+                             "left:int:opt;"
+                             "top:int:opt;"
+                             "right:int:opt;"
+                             "bottom:int:opt;"
+                             "autocrop:int:opt;",
+                             "clip:vnode;",
+                             deCrossCreate, (void *)DECROSS_OUTPUT_EDGES, plugin);
+}
@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+#include "cpu.h"
+#include "kernels.h"
+
+
+template <typename PixelType>
+static FORCE_INLINE bool IsEdge(const PixelType *pSrc, int x, int nYThreshold) {
+    int left = pSrc[x - 1];
+    int center = pSrc[x];
+    int right = pSrc[x + 1];
+
+    return std::abs(left - right) > nYThreshold &&
+           ((center > left && right > center) || (left > center && center > right));
+}
+
+
+// Works on the same 4 pixel blocks as the SIMD versions. A chroma pixel is
+// an edge if any of the luma pixels it covers is one.
+template <int subSamplingW, int nMargin, typename PixelType>
+static void EdgeCheck(const PixelType *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold) {
+    for (int nX = 4; nX < nRowSizeU - 4; nX += 4) {
+        for (int x = nX; x < nX + 4; x++) {
+            bool edge = false;
+            for (int i = 0; i < 1 << subSamplingW; i++)
+                edge = edge || IsEdge(pSrc, (x << subSamplingW) + i, nYThreshold);
+
+            if (edge)
+                for (int i = -nMargin; i <= nMargin; i++)
+                    pEdgeBuffer[x + i] = 1;
+        }
+    }
+}
+
+
+template <typename PixelType, int subSamplingW>
+static FORCE_INLINE int Diff(const uint8_t * const *pLumaRows, const DeCrossCandidate &cand, int nXLuma) {
+    const PixelType *pDiff0 = (const PixelType *)pLumaRows[cand.nLumaRef] + nXLuma + cand.nShift;
+    const PixelType *pDiff1 = (const PixelType *)pLumaRows[cand.nLumaCur] + nXLuma;
+
+    int nDiff = 0;
+    for (int i = 0; i < 4 << subSamplingW; i++)
+        nDiff += std::abs(pDiff0[i] - pDiff1[i]);
+
+    return nDiff;
+}
+
+
+template <typename PixelType, int subSamplingW>
+static void Search(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest) {
+    const DeCrossCandidate *pCandidates = pOrder->candidates;
+
+    (void)nRowSizeU;
+
+    for (int nX = nXStart; nX < nXEnd; nX += 4) {
+        int nBlock = nX / 4;
+        int nXLuma = nX << subSamplingW;
+        int nMiniKey = SAD_KEY(nNoiseThreshold, 0);
+        int nNextKey = INT_MAX;
+
+        bool bLoad = CanLoadKeys(pShared, nBlock, 1);
+        if (bLoad)
+            nMiniKey = std::min(nMiniKey, *LoadKeys(pShared, nBlock));
+
+        int c = 0;
+
+        for ( ; c < pOrder->nForwarded; c++) {
+            int nDiff = Diff<PixelType, subSamplingW>(pLumaRows, pCandidates[c], nXLuma);
+
+            nMiniKey = std::min(nMiniKey, SAD_KEY(nDiff, pCandidates[c].nIndex));
+            nNextKey = std::min(nNextKey, SAD_KEY(nDiff, pCandidates[c].nNext));
+        }
+
+        for (int nEnd = bLoad ? pOrder->nUncovered : pOrder->nCandidates; c < nEnd; ) {
+            for (int nStep = std::min(c + pOrder->nStopStep, nEnd); c < nStep; c++)
+                nMiniKey = std::min(nMiniKey, SAD_KEY((Diff<PixelType, subSamplingW>(pLumaRows, pCandidates[c], nXLuma)), pCandidates[c].nIndex));
+
+            if (nMiniKey < pOrder->nStopKey)
+                break;
+        }
+
+        if (pShared)
+            *StoreKeys(pShared, nBlock, 1) = nNextKey;
+
+        pBest[nBlock] = BestCandidate(nMiniKey, nNoiseThreshold);
+    }
+}
+
+
+template <typename PixelType>
+static void AverageChroma(const uint8_t *pSrcU8, const uint8_t *pSrcV8, const uint8_t *pSrcUMini8, const uint8_t *pSrcVMini8, uint8_t *pDestU8, uint8_t *pDestV8, const uint8_t *pEdgeBuffer, int nX) {
+    const PixelType *pSrcU = (const PixelType *)pSrcU8;
+    const PixelType *pSrcV = (const PixelType *)pSrcV8;
+    const PixelType *pSrcUMini = (const PixelType *)pSrcUMini8;
+    const PixelType *pSrcVMini = (const PixelType *)pSrcVMini8;
+    PixelType *pDestU = (PixelType *)pDestU8;
+    PixelType *pDestV = (PixelType *)pDestV8;
+
+    for (int i = 0; i < 4; i++) {
+        if (pEdgeBuffer[nX + i] == 0) {
+            pDestU[nX + i] = pSrcU[nX + i];
+            pDestV[nX + i] = pSrcV[nX + i];
+        } else {
+            pDestU[nX + i] = (pSrcU[nX + i] + pSrcUMini[nX + i] + 1) >> 1;
+            pDestV[nX + i] = (pSrcV[nX + i] + pSrcVMini[nX + i] + 1) >> 1;
+        }
+    }
+}
+
+
+template <int subSamplingW>
+void EdgeCheck_C(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin) {
+    DISPATCH_MARGIN(nMargin, EdgeCheck, subSamplingW, (pSrc, pEdgeBuffer, nRowSizeU, nYThreshold));
+}
+
+
+template <int subSamplingW>
+void Search_C(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest) {
+    Search<uint8_t, subSamplingW>(pLumaRows, pOrder, nXStart, nXEnd, nRowSizeU, nNoiseThreshold, pShared, pBest);
+}
+
+
+void AverageChroma_C(const uint8_t *pSrcU, const uint8_t *pSrcV, const uint8_t *pSrcUMini, const uint8_t *pSrcVMini, uint8_t *pDestU, uint8_t *pDestV, const uint8_t *pEdgeBuffer, int nX) {
+    AverageChroma<uint8_t>(pSrcU, pSrcV, pSrcUMini, pSrcVMini, pDestU, pDestV, pEdgeBuffer, nX);
+}
+
+
+template <int subSamplingW>
+void EdgeCheck16_C(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin) {
+    DISPATCH_MARGIN(nMargin, EdgeCheck, subSamplingW, ((const uint16_t *)pSrc, pEdgeBuffer, nRowSizeU, nYThreshold));
+}
+
+
+template <int subSamplingW>
+void Search16_C(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest) {
+    Search<uint16_t, subSamplingW>(pLumaRows, pOrder, nXStart, nXEnd, nRowSizeU, nNoiseThreshold, pShared, pBest);
+}
+
+
+void AverageChroma16_C(const uint8_t *pSrcU, const uint8_t *pSrcV, const uint8_t *pSrcUMini, const uint8_t *pSrcVMini, uint8_t *pDestU, uint8_t *pDestV, const uint8_t *pEdgeBuffer, int nX) {
+    AverageChroma<uint16_t>(pSrcU, pSrcV, pSrcUMini, pSrcVMini, pDestU, pDestV, pEdgeBuffer, nX);
+}
+
+
+// The 16 bit kernels stop at AVX2.
+template <int subSamplingW>
+static int deCrossSelectKernels16(DeCrossKernels *kernels, int opt) {
+    kernels->edgeCheck = EdgeCheck16_C<subSamplingW>;
+    kernels->search = Search16_C<subSamplingW>;
+    kernels->averageChroma = AverageChroma16_C;
+    kernels->nSearchWidth = 4;
+
+    int level = DECROSS_OPT_C;
+
+#if defined (DECROSS_X86)
+    uint32_t features = deCrossGetCPUFeatures();
+
+    if (opt >= DECROSS_OPT_SSE2 && (features & DECROSS_CPU_SSE2)) {
+        kernels->edgeCheck = EdgeCheck16_SSE2<subSamplingW>;
+        kernels->search = Search16_SSE2<subSamplingW>;
+        kernels->averageChroma = AverageChroma16_SSE2;
+        kernels->nSearchWidth = 16;
+        level = DECROSS_OPT_SSE2;
+    }
+
+    if (opt >= DECROSS_OPT_AVX2 && (features & DECROSS_CPU_AVX2)) {
+        kernels->edgeCheck = EdgeCheck16_AVX2<subSamplingW>;
+        kernels->search = Search16_AVX2<subSamplingW>;
+        kernels->nSearchWidth = 32;
+        level = DECROSS_OPT_AVX2;
+    }
+#elif defined (DECROSS_VECTOR)
+    if (opt >= DECROSS_OPT_SSE2 && deCrossSelectVectorKernels(kernels, 16, subSamplingW))
+        level = DECROSS_OPT_SSE2;
+#else
+    (void)opt;
+#endif
+
+    return level;
+}
+
+
+template <int subSamplingW>
+static void deCrossSelectVectorKernelsW(DeCrossKernels *kernels, int nBitsPerSample) {
+#if defined (DECROSS_VECTOR)
+    if (nBitsPerSample > 8) {
+        kernels->edgeCheck = EdgeCheck16_Vector<subSamplingW>;
+        kernels->search = Search16_Vector<subSamplingW>;
+        kernels->averageChroma = AverageChroma16_Vector;
+        kernels->nSearchWidth = 4;
+    } else {
+        kernels->edgeCheck = EdgeCheck_Vector<subSamplingW>;
+        kernels->search = Search_Vector<subSamplingW>;
+        kernels->averageChroma = AverageChroma_Vector;
+        kernels->nSearchWidth = 16;
+    }
+#else
+    (void)kernels;
+    (void)nBitsPerSample;
+#endif
+}
+
+
+bool deCrossSelectVectorKernels(DeCrossKernels *kernels, int nBitsPerSample, int subSamplingW) {
+#if defined (DECROSS_VECTOR)
+    if (subSamplingW == 0)
+        deCrossSelectVectorKernelsW<0>(kernels, nBitsPerSample);
+    else if (subSamplingW == 2)
+        deCrossSelectVectorKernelsW<2>(kernels, nBitsPerSample);
+    else
+        deCrossSelectVectorKernelsW<1>(kernels, nBitsPerSample);
+
+    return true;
+#else
+    (void)kernels;
+    (void)nBitsPerSample;
+    (void)subSamplingW;
+
+    return false;
+#endif
+}
+
+
+template <int subSamplingW>
+static int deCrossSelectKernelsW(DeCrossKernels *kernels, int opt, int nBitsPerSample) {
+    if (nBitsPerSample > 8)
+        return deCrossSelectKernels16<subSamplingW>(kernels, opt);
+
+    kernels->edgeCheck = EdgeCheck_C<subSamplingW>;
+    kernels->search = Search_C<subSamplingW>;
+    kernels->averageChroma = AverageChroma_C;
+    kernels->nSearchWidth = 4;
+
+    int level = DECROSS_OPT_C;
+
+#if defined (DECROSS_X86)
+    uint32_t features = deCrossGetCPUFeatures();
+
+    if (opt >= DECROSS_OPT_SSE2 && (features & DECROSS_CPU_SSE2)) {
+        kernels->edgeCheck = EdgeCheck_SSE2<subSamplingW>;
+        kernels->search = Search_SSE2<subSamplingW>;
+        kernels->averageChroma = AverageChroma_SSE2;
+        kernels->nSearchWidth = 8;
+        level = DECROSS_OPT_SSE2;
+    }
+
+    if (opt >= DECROSS_OPT_AVX2 && (features & DECROSS_CPU_AVX2)) {
+        kernels->edgeCheck = EdgeCheck_AVX2<subSamplingW>;
+        kernels->search = Search_AVX2<subSamplingW>;
+        kernels->nSearchWidth = 16;
+        level = DECROSS_OPT_AVX2;
+    }
+
+    if (opt >= DECROSS_OPT_AVX512 && (features & DECROSS_CPU_AVX512)) {
+        kernels->search = Search_AVX512<subSamplingW>;
+        kernels->nSearchWidth = 32;
+        level = DECROSS_OPT_AVX512;
+    }
+#elif defined (DECROSS_VECTOR)
+    if (opt >= DECROSS_OPT_SSE2 && deCrossSelectVectorKernels(kernels, 8, subSamplingW))
+        level = DECROSS_OPT_SSE2;
+#else
+    (void)opt;
+#endif
+
+    return level;
+}
+
+
+int deCrossSelectKernels(DeCrossKernels *kernels, int opt, int nBitsPerSample, int subSamplingW) {
+    if (subSamplingW == 0)
+        return deCrossSelectKernelsW<0>(kernels, opt, nBitsPerSample);
+    else if (subSamplingW == 2)
+        return deCrossSelectKernelsW<2>(kernels, opt, nBitsPerSample);
+
+    return deCrossSelectKernelsW<1>(kernels, opt, nBitsPerSample);
+}
@@ -0,0 +1,253 @@
+#ifndef DECROSS_KERNELS_H
+#define DECROSS_KERNELS_H
+
+#include <cstdint>
+
+
+#ifdef _WIN32
+#define FORCE_INLINE __forceinline
+#else
+#define FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+
+enum DeCrossFrameIndex {
+    FRAME_PREV,
+    FRAME_CUR,
+    FRAME_NEXT,
+    FRAME_COUNT
+};
+
+
+// Luma rows -2..+2 and chroma rows -1..+1 around the current chroma row,
+// for each of the three frames.
+#define LUMA_ROWS 5
+#define CHROMA_ROWS 3
+#define LUMA_ROW(frame, row) ((frame) * LUMA_ROWS + (row) + 2)
+#define CHROMA_ROW(frame, row) ((frame) * CHROMA_ROWS + (row) + 1)
+
+
+typedef struct DeCrossCandidate {
+    int nLumaRef; // LUMA_ROW() of the luma compared with the current luma
+    int nLumaCur; // LUMA_ROW() of the current luma
+    int nShift; // horizontal offset of nLumaRef, in luma pixels
+    int nChroma; // CHROMA_ROW() of the chroma used if this candidate wins
+    int nChromaShift; // horizontal offset of nChroma, in chroma pixels
+    int nIndex; // position in the row's table, which decides ties
+    int nNext; // nIndex of the candidate of the next row comparing the same luma, or -1
+} DeCrossCandidate;
+
+#define MAX_CANDIDATES 34
+
+
+// The candidates of a row in the order the search visits them: first those
+// needed by the next row, then the others, then those the previous row's
+// keys already cover.
+//
+// After the forwarded candidates, the search of a block stops at the end of
+// the first group of nStopStep candidates that leaves its key below
+// nStopKey. A nStopKey of 0 never stops it.
+typedef struct DeCrossSearchOrder {
+    DeCrossCandidate candidates[MAX_CANDIDATES];
+    int nForwarded;
+    int nUncovered;
+    int nCandidates;
+    int nStopKey;
+    int nStopStep;
+} DeCrossSearchOrder;
+
+
+// The search ranks the candidates by SAD_KEY(). The smallest key has the
+// smallest sum of absolute differences and, among equal sums, the earliest
+// candidate, so keys can be compared in any order.
+#define SAD_KEY(nDiff, nCandidate) (((nDiff) << 8) | (nCandidate))
+
+
+// When consecutive chroma rows are one luma row apart, many candidates of
+// a row compare the same luma as candidates of the previous row. The search
+// passes the smallest key of those to the next row, one per block, and the
+// next row skips them.
+typedef struct DeCrossSharedKeys {
+    int *pKey[2]; // pKey[nRow & 1] is written, pKey[(nRow - 1) & 1] is read
+    int *pStamp[2]; // the row that wrote each block's key
+    int nRow;
+} DeCrossSharedKeys;
+
+
+// Above 8 bits the planes hold uint16_t pixels. The kernels still take
+// uint8_t pointers to them, and nX still counts pixels.
+//
+// The kernels that read the luma have an instance for each horizontal
+// subsampling, subSamplingW from 0 to MAX_SUBSAMPLING_W. Chroma pixel nX
+// covers the 1 << subSamplingW luma pixels from nX << subSamplingW on, so a
+// block of 4 chroma pixels covers 4 << subSamplingW luma pixels.
+#define MAX_SUBSAMPLING_W 2
+
+// How far the candidates reach past a block, in chroma pixels. The largest
+// chroma shift is 3 pixels, except in 4:4:4, which shifts by the 6 luma
+// pixels instead.
+#define SEARCH_REACH(subSamplingW) ((subSamplingW) ? 3 : 6)
+
+// Sets the edge flags of the chroma pixels whose luma is a horizontal edge,
+// expanded to the left and right by nMargin pixels, from 0 to MAX_MARGIN.
+// pEdgeBuffer must be clear.
+typedef void (*EdgeCheckFunction)(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin);
+
+// For every block of 4 chroma pixels from nXStart up to nXEnd, stores in
+// pBest[nX / 4] the nIndex of the candidate with the smallest sum of
+// absolute differences over the block's luma pixels, or -1 if none of them
+// is below nNoiseThreshold. Ties go to the smaller nIndex, unless the search
+// stops early, as described at DeCrossSearchOrder. The wider kernels
+// may also search some of the blocks after nXEnd, but none whose luma
+// reaches past nRowSizeU at the largest offset. pShared may be NULL if no
+// candidate is linked to another row.
+typedef void (*SearchFunction)(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest);
+
+// Blends the 4 chroma pixels starting at nX with the chosen candidate,
+// where the edge flags are set.
+typedef void (*AverageChromaFunction)(const uint8_t *pSrcU, const uint8_t *pSrcV, const uint8_t *pSrcUMini, const uint8_t *pSrcVMini, uint8_t *pDestU, uint8_t *pDestV, const uint8_t *pEdgeBuffer, int nX);
+
+
+typedef struct DeCrossKernels {
+    EdgeCheckFunction edgeCheck;
+    SearchFunction search;
+    AverageChromaFunction averageChroma;
+    int nSearchWidth; // chroma pixels searched at once by the widest part of search
+} DeCrossKernels;
+
+
+enum DeCrossOpt {
+    DECROSS_OPT_C,
+    DECROSS_OPT_SSE2, // the portable vector kernels on other CPUs
+    DECROSS_OPT_AVX2,
+    DECROSS_OPT_AVX512
+};
+
+
+// Picks the fastest kernels the CPU supports for the bit depth and the
+// horizontal subsampling, up to the level opt. Returns the level actually
+// used.
+int deCrossSelectKernels(DeCrossKernels *kernels, int opt, int nBitsPerSample, int subSamplingW);
+
+
+// The vector extensions of GCC and Clang, which the portable kernels are
+// written with. __builtin_convertvector came with GCC 9.
+#if defined (__clang__) || (defined (__GNUC__) && __GNUC__ >= 9)
+#define DECROSS_VECTOR 1
+#endif
+
+// Picks the portable vector kernels for the bit depth and the horizontal
+// subsampling, whatever the CPU, so that they can be checked on x86 too.
+// Returns false if they weren't built.
+bool deCrossSelectVectorKernels(DeCrossKernels *kernels, int nBitsPerSample, int subSamplingW);
+
+
+#define MAX_MARGIN 4
+
+// Calls function<subSamplingW, nMargin> arguments. The edge checks have an
+// instance for each margin, so that the loops over it unroll and the SIMD
+// versions can shift by it.
+#define DISPATCH_MARGIN(nMargin, function, subSamplingW, arguments) \
+    switch (nMargin) { \
+    case 0: function<subSamplingW, 0> arguments; break; \
+    case 1: function<subSamplingW, 1> arguments; break; \
+    case 2: function<subSamplingW, 2> arguments; break; \
+    case 3: function<subSamplingW, 3> arguments; break; \
+    default: function<subSamplingW, 4> arguments; break; \
+    }
+
+static_assert(MAX_MARGIN == 4, "DISPATCH_MARGIN needs a case for every margin");
+
+
+// Helpers for the search kernels. A group of nBlocks blocks starting at
+// nBlock can use the previous row's keys only if all of them were written.
+static FORCE_INLINE bool CanLoadKeys(const DeCrossSharedKeys *pShared, int nBlock, int nBlocks) {
+    if (!pShared)
+        return false;
+
+    const int *pStamp = pShared->pStamp[(pShared->nRow - 1) & 1];
+
+    for (int i = 0; i < nBlocks; i++)
+        if (pStamp[nBlock + i] != pShared->nRow - 1)
+            return false;
+
+    return true;
+}
+
+
+static FORCE_INLINE const int *LoadKeys(const DeCrossSharedKeys *pShared, int nBlock) {
+    return pShared->pKey[(pShared->nRow - 1) & 1] + nBlock;
+}
+
+
+static FORCE_INLINE int *StoreKeys(DeCrossSharedKeys *pShared, int nBlock, int nBlocks) {
+    int *pStamp = pShared->pStamp[pShared->nRow & 1];
+
+    for (int i = 0; i < nBlocks; i++)
+        pStamp[nBlock + i] = pShared->nRow;
+
+    return pShared->pKey[pShared->nRow & 1] + nBlock;
+}
+
+
+static FORCE_INLINE int8_t BestCandidate(int nMiniKey, int nNoiseThreshold) {
+    return nMiniKey < SAD_KEY(nNoiseThreshold, 0) ? (int8_t)(nMiniKey & 255) : -1;
+}
+
+
+// Instantiates a kernel template for every horizontal subsampling, with
+// one of the parameter lists below, for the other files.
+#define INSTANTIATE_SUBSAMPLING_W(function, parameters) \
+    template void function<0> parameters; \
+    template void function<1> parameters; \
+    template void function<2> parameters;
+
+static_assert(MAX_SUBSAMPLING_W == 2, "INSTANTIATE_SUBSAMPLING_W needs an instance for every subsampling");
+
+#define EDGE_CHECK_PARAMETERS (const uint8_t *, uint8_t *, int, int, int)
+#define SEARCH_PARAMETERS (const uint8_t * const *, const DeCrossSearchOrder *, int, int, int, int, DeCrossSharedKeys *, int8_t *)
+#define SEARCH_BLOCK_PARAMETERS (const uint8_t * const *, const DeCrossSearchOrder *, int, int, DeCrossSharedKeys *, int8_t *)
+
+
+template <int subSamplingW> void EdgeCheck_C(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin);
+template <int subSamplingW> void Search_C(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest);
+void AverageChroma_C(const uint8_t *pSrcU, const uint8_t *pSrcV, const uint8_t *pSrcUMini, const uint8_t *pSrcVMini, uint8_t *pDestU, uint8_t *pDestV, const uint8_t *pEdgeBuffer, int nX);
+
+template <int subSamplingW> void EdgeCheck16_C(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin);
+template <int subSamplingW> void Search16_C(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest);
+void AverageChroma16_C(const uint8_t *pSrcU, const uint8_t *pSrcV, const uint8_t *pSrcUMini, const uint8_t *pSrcVMini, uint8_t *pDestU, uint8_t *pDestV, const uint8_t *pEdgeBuffer, int nX);
+
+#if defined (DECROSS_VECTOR)
+template <int subSamplingW> void EdgeCheck_Vector(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin);
+template <int subSamplingW> void Search_Vector(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest);
+void AverageChroma_Vector(const uint8_t *pSrcU, const uint8_t *pSrcV, const uint8_t *pSrcUMini, const uint8_t *pSrcVMini, uint8_t *pDestU, uint8_t *pDestV, const uint8_t *pEdgeBuffer, int nX);
+
+template <int subSamplingW> void EdgeCheck16_Vector(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin);
+template <int subSamplingW> void Search16_Vector(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest);
+void AverageChroma16_Vector(const uint8_t *pSrcU, const uint8_t *pSrcV, const uint8_t *pSrcUMini, const uint8_t *pSrcVMini, uint8_t *pDestU, uint8_t *pDestV, const uint8_t *pEdgeBuffer, int nX);
+#endif
+
+#if defined (DECROSS_X86)
+// Searches the single block at nX. Used for the blocks left over by the wider kernels.
+template <int subSamplingW> void SearchBlock_SSE2(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nX, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest);
+
+template <int subSamplingW> void EdgeCheck_SSE2(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin);
+template <int subSamplingW> void Search_SSE2(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest);
+void AverageChroma_SSE2(const uint8_t *pSrcU, const uint8_t *pSrcV, const uint8_t *pSrcUMini, const uint8_t *pSrcVMini, uint8_t *pDestU, uint8_t *pDestV, const uint8_t *pEdgeBuffer, int nX);
+
+template <int subSamplingW> void EdgeCheck_AVX2(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin);
+template <int subSamplingW> void Search_AVX2(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest);
+
+template <int subSamplingW> void Search_AVX512(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest);
+
+template <int subSamplingW> void SearchBlock16_SSE2(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nX, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest);
+
+template <int subSamplingW> void EdgeCheck16_SSE2(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin);
+template <int subSamplingW> void Search16_SSE2(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest);
+void AverageChroma16_SSE2(const uint8_t *pSrcU, const uint8_t *pSrcV, const uint8_t *pSrcUMini, const uint8_t *pSrcVMini, uint8_t *pDestU, uint8_t *pDestV, const uint8_t *pEdgeBuffer, int nX);
+
+template <int subSamplingW> void EdgeCheck16_AVX2(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin);
+template <int subSamplingW> void Search16_AVX2(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest);
+#endif
+
+#endif // DECROSS_KERNELS_H
@@ -0,0 +1,528 @@
+#include <algorithm>
+#include <climits>
+
+#include <immintrin.h>
+
+#include "kernels.h"
+
+
+static FORCE_INLINE __m256i EdgeMask(__m256i mLeft, __m256i mCenter, __m256i mRight, __m256i mYThreshold) {
+    __m256i bytes_128 = _mm256_set1_epi8(128);
+
+    __m256i mLeft_128 = _mm256_sub_epi8(mLeft, bytes_128);
+    __m256i mCenter_128 = _mm256_sub_epi8(mCenter, bytes_128);
+    __m256i mRight_128 = _mm256_sub_epi8(mRight, bytes_128);
+
+    __m256i abs_diff_left_right = _mm256_or_si256(_mm256_subs_epu8(mLeft, mRight),
+                                                  _mm256_subs_epu8(mRight, mLeft));
+    abs_diff_left_right = _mm256_sub_epi8(abs_diff_left_right, bytes_128);
+
+    return _mm256_and_si256(_mm256_cmpgt_epi8(abs_diff_left_right, mYThreshold),
+                            _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi8(mCenter_128, mLeft_128),
+                                                             _mm256_cmpgt_epi8(mRight_128, mCenter_128)),
+                                            _mm256_and_si256(_mm256_cmpgt_epi8(mLeft_128, mCenter_128),
+                                                             _mm256_cmpgt_epi8(mCenter_128, mRight_128))));
+}
+
+
+// Byte i of the result is set if any of bytes i - nBytes to i of mEdge is.
+template <int nBytes>
+static FORCE_INLINE __m128i Spread(__m128i mEdge) {
+    return _mm_or_si128(_mm_slli_si128(mEdge, nBytes), Spread<nBytes - 1>(mEdge));
+}
+
+
+template <>
+FORCE_INLINE __m128i Spread<0>(__m128i mEdge) {
+    return mEdge;
+}
+
+
+// The bytes Spread() pushes out of the register, from byte 16 on.
+template <int nBytes>
+static FORCE_INLINE __m128i SpreadOut(__m128i mEdge) {
+    return _mm_or_si128(_mm_srli_si128(mEdge, 16 - nBytes), SpreadOut<nBytes - 1>(mEdge));
+}
+
+
+template <>
+FORCE_INLINE __m128i SpreadOut<0>(__m128i) {
+    return _mm_setzero_si128();
+}
+
+
+// Adds the flags of the nPixels chroma pixels at nX, the low nPixels bytes
+// of mEdge with the others clear, to mCarry, which holds those of the
+// pixels from nX - nMargin on, and stores the nPixels pixels no later block
+// reaches. The edge buffer is written once instead of being read and
+// written back for every offset in the margin.
+template <int nMargin, int nPixels>
+static FORCE_INLINE void StoreEdges(uint8_t *pEdgeBuffer, int nX, __m128i mEdge, __m128i &mCarry) {
+    __m128i mFlags = _mm_or_si128(mCarry, Spread<2 * nMargin>(mEdge));
+    __m128i *pDest = (__m128i *)&pEdgeBuffer[nX - nMargin];
+
+    if (nPixels == 16)
+        _mm_storeu_si128(pDest, mFlags);
+    else if (nPixels == 8)
+        _mm_storel_epi64(pDest, mFlags);
+    else
+        *(int *)pDest = _mm_cvtsi128_si32(mFlags);
+
+    mCarry = _mm_srli_si128(mFlags, nPixels);
+
+    if (nPixels + 2 * nMargin > 16)
+        mCarry = _mm_or_si128(mCarry, SpreadOut<2 * nMargin>(mEdge));
+}
+
+
+static FORCE_INLINE __m256i Load(const uint8_t *pSrc) {
+    return _mm256_loadu_si256((const __m256i *)pSrc);
+}
+
+
+// The edge flags of the 4 blocks of 4 chroma pixels whose luma starts at
+// pSrc, one byte per chroma pixel. The signed saturation keeps every
+// nonzero group of luma flags nonzero.
+template <int subSamplingW>
+static FORCE_INLINE __m128i ChromaEdges4(const uint8_t *pSrc, __m256i mYThreshold);
+
+
+template <>
+FORCE_INLINE __m128i ChromaEdges4<0>(const uint8_t *pSrc, __m256i mYThreshold) {
+    __m256i mLeft   = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(pSrc - 1)));
+    __m256i mCenter = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)pSrc));
+    __m256i mRight  = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(pSrc + 1)));
+
+    return _mm256_castsi256_si128(EdgeMask(mLeft, mCenter, mRight, mYThreshold));
+}
+
+
+template <>
+FORCE_INLINE __m128i ChromaEdges4<1>(const uint8_t *pSrc, __m256i mYThreshold) {
+    __m256i mEdge = EdgeMask(Load(pSrc - 1), Load(pSrc), Load(pSrc + 1), mYThreshold);
+
+    mEdge = _mm256_packs_epi16(mEdge, mEdge);
+    return _mm256_castsi256_si128(_mm256_permute4x64_epi64(mEdge, _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+
+template <>
+FORCE_INLINE __m128i ChromaEdges4<2>(const uint8_t *pSrc, __m256i mYThreshold) {
+    __m256i mEdge0 = EdgeMask(Load(pSrc - 1), Load(pSrc), Load(pSrc + 1), mYThreshold);
+    __m256i mEdge1 = EdgeMask(Load(pSrc + 31), Load(pSrc + 32), Load(pSrc + 33), mYThreshold);
+
+    // Blocks 0 2 in the low lane and 1 3 in the high one.
+    __m256i mEdge = _mm256_packs_epi32(mEdge0, mEdge1);
+    mEdge = _mm256_packs_epi16(mEdge, mEdge);
+
+    return _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(mEdge, _mm256_setr_epi32(0, 4, 1, 5, 0, 4, 1, 5)));
+}
+
+
+// The edge flags of the single block whose luma starts at pSrc, in the low
+// 4 bytes.
+template <int subSamplingW>
+static FORCE_INLINE __m128i ChromaEdges1(const uint8_t *pSrc, __m256i mYThreshold) {
+    __m256i mLeft, mCenter, mRight;
+
+    if (subSamplingW == 0) {
+        mLeft   = _mm256_castsi128_si256(_mm_cvtsi32_si128(*(const int *)(pSrc - 1)));
+        mCenter = _mm256_castsi128_si256(_mm_cvtsi32_si128(*(const int *)pSrc));
+        mRight  = _mm256_castsi128_si256(_mm_cvtsi32_si128(*(const int *)(pSrc + 1)));
+    } else if (subSamplingW == 1) {
+        mLeft   = _mm256_castsi128_si256(_mm_loadl_epi64((const __m128i *)(pSrc - 1)));
+        mCenter = _mm256_castsi128_si256(_mm_loadl_epi64((const __m128i *)pSrc));
+        mRight  = _mm256_castsi128_si256(_mm_loadl_epi64((const __m128i *)(pSrc + 1)));
+    } else {
+        mLeft   = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(pSrc - 1)));
+        mCenter = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)pSrc));
+        mRight  = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(pSrc + 1)));
+    }
+
+    __m128i mEdge = _mm256_castsi256_si128(EdgeMask(mLeft, mCenter, mRight, mYThreshold));
+
+    if (subSamplingW == 2)
+        mEdge = _mm_packs_epi32(mEdge, mEdge);
+    if (subSamplingW >= 1)
+        mEdge = _mm_packs_epi16(mEdge, mEdge);
+
+    return _mm_cvtsi32_si128(_mm_cvtsi128_si32(mEdge));
+}
+
+
+// Four blocks of 4 chroma pixels per iteration.
+template <int subSamplingW, int nMargin>
+static void EdgeCheckMargin_AVX2(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold) {
+    __m256i mYThreshold = _mm256_set1_epi8(nYThreshold - 128);
+    __m128i mCarry = _mm_setzero_si128();
+
+    int nX = 4;
+
+    for ( ; nX + 12 < nRowSizeU - 4; nX += 16)
+        StoreEdges<nMargin, 16>(pEdgeBuffer, nX, ChromaEdges4<subSamplingW>(&pSrc[nX << subSamplingW], mYThreshold), mCarry);
+
+    for ( ; nX < nRowSizeU - 4; nX += 4)
+        StoreEdges<nMargin, 4>(pEdgeBuffer, nX, ChromaEdges1<subSamplingW>(&pSrc[nX << subSamplingW], mYThreshold), mCarry);
+
+    _mm_storeu_si128((__m128i *)&pEdgeBuffer[nX - nMargin], mCarry);
+}
+
+
+template <int subSamplingW>
+void EdgeCheck_AVX2(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin) {
+    DISPATCH_MARGIN(nMargin, EdgeCheckMargin_AVX2, subSamplingW, (pSrc, pEdgeBuffer, nRowSizeU, nYThreshold));
+}
+
+
+// The sums of absolute differences of the 4 blocks from pDiff0 and pDiff1,
+// in the low 32 bits of each 64.
+template <int subSamplingW>
+static FORCE_INLINE __m256i SadBlocks4(const uint8_t *pDiff0, const uint8_t *pDiff1);
+
+
+template <>
+FORCE_INLINE __m256i SadBlocks4<0>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    return _mm256_sad_epu8(_mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)pDiff0)),
+                           _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)pDiff1)));
+}
+
+
+template <>
+FORCE_INLINE __m256i SadBlocks4<1>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    return _mm256_sad_epu8(Load(pDiff0), Load(pDiff1));
+}
+
+
+template <>
+FORCE_INLINE __m256i SadBlocks4<2>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    __m256i mSad01 = _mm256_sad_epu8(Load(pDiff0), Load(pDiff1));
+    __m256i mSad23 = _mm256_sad_epu8(Load(pDiff0 + 32), Load(pDiff1 + 32));
+
+    // Blocks 0 2 1 3.
+    __m256i mSad = _mm256_add_epi64(_mm256_unpacklo_epi64(mSad01, mSad23), _mm256_unpackhi_epi64(mSad01, mSad23));
+
+    return _mm256_permute4x64_epi64(mSad, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+
+// Returns the sums shifted into place for SAD_KEY().
+template <int subSamplingW>
+static FORCE_INLINE __m256i Diff4(const uint8_t * const *pLumaRows, const DeCrossCandidate &cand, int nXLuma) {
+    return _mm256_slli_epi32(SadBlocks4<subSamplingW>(&pLumaRows[cand.nLumaRef][nXLuma + cand.nShift], &pLumaRows[cand.nLumaCur][nXLuma]), 8);
+}
+
+
+// Keeps the keys of the blocks whose search stops here. Returns true when
+// all of them have stopped.
+static FORCE_INLINE bool Stop4(__m256i mMiniKey, __m256i mStopKey, __m256i &mDone, __m256i &mDoneKey) {
+    __m256i mStop = _mm256_andnot_si256(mDone, _mm256_cmpgt_epi32(mStopKey, mMiniKey));
+
+    mDoneKey = _mm256_or_si256(mDoneKey, _mm256_and_si256(mStop, mMiniKey));
+    mDone = _mm256_or_si256(mDone, mStop);
+
+    return _mm256_movemask_epi8(mDone) == -1;
+}
+
+
+// Four neighbouring blocks per iteration, each in 64 bits of the sums.
+template <int subSamplingW>
+void Search_AVX2(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest) {
+    const DeCrossCandidate *pCandidates = pOrder->candidates;
+
+    int nX = nXStart;
+
+    for ( ; nX < nXEnd && nX + 16 + SEARCH_REACH(subSamplingW) <= nRowSizeU; nX += 16) {
+        int nBlock = nX / 4;
+        int nXLuma = nX << subSamplingW;
+
+        __m256i mMiniKey = _mm256_set1_epi32(SAD_KEY(nNoiseThreshold, 0));
+        __m256i mNextKey = _mm256_set1_epi32(INT_MAX);
+
+        bool bLoad = CanLoadKeys(pShared, nBlock, 4);
+        if (bLoad)
+            mMiniKey = _mm256_min_epi32(mMiniKey, _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)LoadKeys(pShared, nBlock))));
+
+        int c = 0;
+
+        for ( ; c < pOrder->nForwarded; c++) {
+            __m256i mDiff = Diff4<subSamplingW>(pLumaRows, pCandidates[c], nXLuma);
+
+            mMiniKey = _mm256_min_epi32(mMiniKey, _mm256_or_si256(mDiff, _mm256_set1_epi32(pCandidates[c].nIndex)));
+            mNextKey = _mm256_min_epi32(mNextKey, _mm256_or_si256(mDiff, _mm256_set1_epi32(pCandidates[c].nNext)));
+        }
+
+        __m256i mStopKey = _mm256_set1_epi32(pOrder->nStopKey);
+        __m256i mDone = _mm256_setzero_si256();
+        __m256i mDoneKey = _mm256_setzero_si256();
+
+        for (int nEnd = bLoad ? pOrder->nUncovered : pOrder->nCandidates; c < nEnd; ) {
+            for (int nStep = std::min(c + pOrder->nStopStep, nEnd); c < nStep; c++)
+                mMiniKey = _mm256_min_epi32(mMiniKey, _mm256_or_si256(Diff4<subSamplingW>(pLumaRows, pCandidates[c], nXLuma), _mm256_set1_epi32(pCandidates[c].nIndex)));
+
+            if (Stop4(mMiniKey, mStopKey, mDone, mDoneKey))
+                break;
+        }
+
+        mMiniKey = _mm256_blendv_epi8(mMiniKey, mDoneKey, mDone);
+
+        if (pShared)
+            _mm_storeu_si128((__m128i *)StoreKeys(pShared, nBlock, 4), _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(mNextKey, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6))));
+
+        alignas(32) int nMiniKey[8];
+        _mm256_store_si256((__m256i *)nMiniKey, mMiniKey);
+
+        for (int i = 0; i < 4; i++)
+            pBest[nBlock + i] = BestCandidate(nMiniKey[i * 2], nNoiseThreshold);
+    }
+
+    for ( ; nX < nXEnd; nX += 4)
+        SearchBlock_SSE2<subSamplingW>(pLumaRows, pOrder, nX, nNoiseThreshold, pShared, pBest);
+}
+
+
+// The 16 bit kernels. Unsigned words are compared as signed ones with
+// their top bit flipped.
+
+static FORCE_INLINE __m256i EdgeMask16(__m256i mLeft, __m256i mCenter, __m256i mRight, __m256i mYThreshold) {
+    __m256i words_32768 = _mm256_set1_epi16(-32768);
+
+    __m256i mLeft_32768 = _mm256_xor_si256(mLeft, words_32768);
+    __m256i mCenter_32768 = _mm256_xor_si256(mCenter, words_32768);
+    __m256i mRight_32768 = _mm256_xor_si256(mRight, words_32768);
+
+    __m256i abs_diff_left_right = _mm256_sub_epi16(_mm256_max_epu16(mLeft, mRight),
+                                                   _mm256_min_epu16(mLeft, mRight));
+    abs_diff_left_right = _mm256_xor_si256(abs_diff_left_right, words_32768);
+
+    __m256i mEdge = _mm256_and_si256(_mm256_cmpgt_epi16(abs_diff_left_right, mYThreshold),
+                                     _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi16(mCenter_32768, mLeft_32768),
+                                                                      _mm256_cmpgt_epi16(mRight_32768, mCenter_32768)),
+                                                     _mm256_and_si256(_mm256_cmpgt_epi16(mLeft_32768, mCenter_32768),
+                                                                      _mm256_cmpgt_epi16(mCenter_32768, mRight_32768))));
+
+    return mEdge;
+}
+
+
+// The edge flags of the luma pixels from pSrc on, one per word, from a
+// 256 bit load if bFull and a 128 bit one otherwise.
+template <bool bFull>
+static FORCE_INLINE __m256i LumaEdges16(const uint8_t *pSrc, __m256i mYThreshold) {
+    if (bFull)
+        return EdgeMask16(Load(pSrc - 2), Load(pSrc), Load(pSrc + 2), mYThreshold);
+
+    return EdgeMask16(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(pSrc - 2))),
+                      _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)pSrc)),
+                      _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(pSrc + 2))), mYThreshold);
+}
+
+
+// The edge flags of the 2 blocks of 4 chroma pixels whose luma starts at
+// pSrc, one byte per chroma pixel. The signed saturation keeps every
+// nonzero group of luma flags nonzero.
+template <int subSamplingW>
+static FORCE_INLINE __m128i ChromaEdges2_16(const uint8_t *pSrc, __m256i mYThreshold);
+
+
+template <>
+FORCE_INLINE __m128i ChromaEdges2_16<0>(const uint8_t *pSrc, __m256i mYThreshold) {
+    __m128i mEdge = _mm256_castsi256_si128(LumaEdges16<false>(pSrc, mYThreshold));
+
+    return _mm_move_epi64(_mm_packs_epi16(mEdge, mEdge));
+}
+
+
+template <>
+FORCE_INLINE __m128i ChromaEdges2_16<1>(const uint8_t *pSrc, __m256i mYThreshold) {
+    __m256i mEdge = LumaEdges16<true>(pSrc, mYThreshold);
+
+    // One byte per pair of luma pixels, the first four in each lane.
+    mEdge = _mm256_packs_epi32(mEdge, mEdge);
+    mEdge = _mm256_packs_epi16(mEdge, mEdge);
+
+    return _mm_move_epi64(_mm256_castsi256_si128(_mm256_permutevar8x32_epi32(mEdge, _mm256_setr_epi32(0, 4, 0, 4, 0, 4, 0, 4))));
+}
+
+
+template <>
+FORCE_INLINE __m128i ChromaEdges2_16<2>(const uint8_t *pSrc, __m256i mYThreshold) {
+    __m256i mEdge = _mm256_packs_epi32(LumaEdges16<true>(pSrc, mYThreshold), LumaEdges16<true>(pSrc + 32, mYThreshold));
+
+    // Pixels 0 1 of each block in the low lane and 2 3 in the high one.
+    mEdge = _mm256_packs_epi32(mEdge, mEdge);
+    mEdge = _mm256_packs_epi16(mEdge, mEdge);
+
+    return _mm_move_epi64(_mm_unpacklo_epi16(_mm256_castsi256_si128(mEdge), _mm256_extracti128_si256(mEdge, 1)));
+}
+
+
+// The edge flags of the single block whose luma starts at pSrc, in the low
+// 4 bytes.
+template <int subSamplingW>
+static FORCE_INLINE __m128i ChromaEdges1_16(const uint8_t *pSrc, __m256i mYThreshold) {
+    __m128i mEdge;
+
+    if (subSamplingW == 0) {
+        mEdge = _mm256_castsi256_si128(EdgeMask16(_mm256_castsi128_si256(_mm_loadl_epi64((const __m128i *)(pSrc - 2))),
+                                                  _mm256_castsi128_si256(_mm_loadl_epi64((const __m128i *)pSrc)),
+                                                  _mm256_castsi128_si256(_mm_loadl_epi64((const __m128i *)(pSrc + 2))), mYThreshold));
+    } else if (subSamplingW == 1) {
+        mEdge = _mm256_castsi256_si128(LumaEdges16<false>(pSrc, mYThreshold));
+        mEdge = _mm_packs_epi32(mEdge, mEdge);
+    } else {
+        __m256i mEdge16 = LumaEdges16<true>(pSrc, mYThreshold);
+        mEdge = _mm_packs_epi32(_mm256_castsi256_si128(mEdge16), _mm256_extracti128_si256(mEdge16, 1));
+        mEdge = _mm_packs_epi32(mEdge, mEdge);
+    }
+
+    mEdge = _mm_packs_epi16(mEdge, mEdge);
+    return _mm_cvtsi32_si128(_mm_cvtsi128_si32(mEdge));
+}
+
+
+// Two blocks of 4 chroma pixels per iteration.
+template <int subSamplingW, int nMargin>
+static void EdgeCheckMargin16_AVX2(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold) {
+    __m256i mYThreshold = _mm256_set1_epi16((int16_t)(nYThreshold - 32768));
+    __m128i mCarry = _mm_setzero_si128();
+
+    int nX = 4;
+
+    for ( ; nX + 4 < nRowSizeU - 4; nX += 8)
+        StoreEdges<nMargin, 8>(pEdgeBuffer, nX, ChromaEdges2_16<subSamplingW>(&pSrc[(nX << subSamplingW) * 2], mYThreshold), mCarry);
+
+    for ( ; nX < nRowSizeU - 4; nX += 4)
+        StoreEdges<nMargin, 4>(pEdgeBuffer, nX, ChromaEdges1_16<subSamplingW>(&pSrc[(nX << subSamplingW) * 2], mYThreshold), mCarry);
+
+    _mm_storeu_si128((__m128i *)&pEdgeBuffer[nX - nMargin], mCarry);
+}
+
+
+template <int subSamplingW>
+void EdgeCheck16_AVX2(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin) {
+    DISPATCH_MARGIN(nMargin, EdgeCheckMargin16_AVX2, subSamplingW, (pSrc, pEdgeBuffer, nRowSizeU, nYThreshold));
+}
+
+
+// The sums of pairs of absolute differences over 16 luma pixels, each less
+// 65536, so they fit _mm256_madd_epi16.
+static FORCE_INLINE __m256i PairSums16(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    __m256i mDiff0 = _mm256_loadu_si256((const __m256i *)pDiff0);
+    __m256i mDiff1 = _mm256_loadu_si256((const __m256i *)pDiff1);
+
+    __m256i mAbsDiff = _mm256_sub_epi16(_mm256_max_epu16(mDiff0, mDiff1), _mm256_min_epu16(mDiff0, mDiff1));
+
+    return _mm256_madd_epi16(_mm256_xor_si256(mAbsDiff, _mm256_set1_epi16(-32768)), _mm256_set1_epi16(1));
+}
+
+
+// The sums of the 8 blocks from pDiff0 and pDiff1, one per 32 bit element,
+// each less 32768 per luma pixel.
+template <int subSamplingW>
+static FORCE_INLINE __m256i BlockSums8_16(const uint8_t *pDiff0, const uint8_t *pDiff1);
+
+
+template <>
+FORCE_INLINE __m256i BlockSums8_16<0>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    // Blocks 0 1 4 5 in the low lane and 2 3 6 7 in the high one.
+    __m256i mSums = _mm256_hadd_epi32(PairSums16(pDiff0, pDiff1), PairSums16(pDiff0 + 32, pDiff1 + 32));
+
+    return _mm256_permutevar8x32_epi32(mSums, _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7));
+}
+
+
+template <>
+FORCE_INLINE __m256i BlockSums8_16<1>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    // Blocks 0 2 4 6 in the low lane and 1 3 5 7 in the high one.
+    __m256i mSums = _mm256_hadd_epi32(_mm256_hadd_epi32(PairSums16(pDiff0, pDiff1), PairSums16(pDiff0 + 32, pDiff1 + 32)),
+                                      _mm256_hadd_epi32(PairSums16(pDiff0 + 64, pDiff1 + 64), PairSums16(pDiff0 + 96, pDiff1 + 96)));
+
+    return _mm256_permutevar8x32_epi32(mSums, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+
+template <>
+FORCE_INLINE __m256i BlockSums8_16<2>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    __m256i mSums[2];
+
+    // The first halves of blocks 0 1 2 3 in the low lane and their second
+    // halves in the high one, then the same for blocks 4 5 6 7.
+    for (int i = 0; i < 2; i++, pDiff0 += 128, pDiff1 += 128)
+        mSums[i] = _mm256_hadd_epi32(_mm256_hadd_epi32(PairSums16(pDiff0, pDiff1), PairSums16(pDiff0 + 32, pDiff1 + 32)),
+                                     _mm256_hadd_epi32(PairSums16(pDiff0 + 64, pDiff1 + 64), PairSums16(pDiff0 + 96, pDiff1 + 96)));
+
+    return _mm256_add_epi32(_mm256_permute2x128_si256(mSums[0], mSums[1], 0x20),
+                            _mm256_permute2x128_si256(mSums[0], mSums[1], 0x31));
+}
+
+
+// One block per 32 bit element, shifted into place for SAD_KEY().
+template <int subSamplingW>
+static FORCE_INLINE __m256i Diff8_16(const uint8_t * const *pLumaRows, const DeCrossCandidate &cand, int nXLuma) {
+    __m256i mSums = BlockSums8_16<subSamplingW>(&pLumaRows[cand.nLumaRef][(nXLuma + cand.nShift) * 2], &pLumaRows[cand.nLumaCur][nXLuma * 2]);
+
+    return _mm256_slli_epi32(_mm256_add_epi32(mSums, _mm256_set1_epi32((4 << subSamplingW) * 32768)), 8);
+}
+
+
+// Eight neighbouring blocks per iteration. Stop4() works on any 32 bit
+// elements.
+template <int subSamplingW>
+void Search16_AVX2(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest) {
+    const DeCrossCandidate *pCandidates = pOrder->candidates;
+
+    int nX = nXStart;
+
+    for ( ; nX < nXEnd && nX + 32 + SEARCH_REACH(subSamplingW) <= nRowSizeU; nX += 32) {
+        int nBlock = nX / 4;
+        int nXLuma = nX << subSamplingW;
+
+        __m256i mMiniKey = _mm256_set1_epi32(SAD_KEY(nNoiseThreshold, 0));
+        __m256i mNextKey = _mm256_set1_epi32(INT_MAX);
+
+        bool bLoad = CanLoadKeys(pShared, nBlock, 8);
+        if (bLoad)
+            mMiniKey = _mm256_min_epi32(mMiniKey, _mm256_loadu_si256((const __m256i *)LoadKeys(pShared, nBlock)));
+
+        int c = 0;
+
+        for ( ; c < pOrder->nForwarded; c++) {
+            __m256i mDiff = Diff8_16<subSamplingW>(pLumaRows, pCandidates[c], nXLuma);
+
+            mMiniKey = _mm256_min_epi32(mMiniKey, _mm256_or_si256(mDiff, _mm256_set1_epi32(pCandidates[c].nIndex)));
+            mNextKey = _mm256_min_epi32(mNextKey, _mm256_or_si256(mDiff, _mm256_set1_epi32(pCandidates[c].nNext)));
+        }
+
+        __m256i mStopKey = _mm256_set1_epi32(pOrder->nStopKey);
+        __m256i mDone = _mm256_setzero_si256();
+        __m256i mDoneKey = _mm256_setzero_si256();
+
+        for (int nEnd = bLoad ? pOrder->nUncovered : pOrder->nCandidates; c < nEnd; ) {
+            for (int nStep = std::min(c + pOrder->nStopStep, nEnd); c < nStep; c++)
+                mMiniKey = _mm256_min_epi32(mMiniKey, _mm256_or_si256(Diff8_16<subSamplingW>(pLumaRows, pCandidates[c], nXLuma), _mm256_set1_epi32(pCandidates[c].nIndex)));
+
+            if (Stop4(mMiniKey, mStopKey, mDone, mDoneKey))
+                break;
+        }
+
+        mMiniKey = _mm256_blendv_epi8(mMiniKey, mDoneKey, mDone);
+
+        if (pShared)
+            _mm256_storeu_si256((__m256i *)StoreKeys(pShared, nBlock, 8), mNextKey);
+
+        alignas(32) int nMiniKey[8];
+        _mm256_store_si256((__m256i *)nMiniKey, mMiniKey);
+
+        for (int i = 0; i < 8; i++)
+            pBest[nBlock + i] = BestCandidate(nMiniKey[i], nNoiseThreshold);
+    }
+
+    for ( ; nX < nXEnd; nX += 4)
+        SearchBlock16_SSE2<subSamplingW>(pLumaRows, pOrder, nX, nNoiseThreshold, pShared, pBest);
+}
+
+
+INSTANTIATE_SUBSAMPLING_W(EdgeCheck_AVX2, EDGE_CHECK_PARAMETERS)
+INSTANTIATE_SUBSAMPLING_W(Search_AVX2, SEARCH_PARAMETERS)
+INSTANTIATE_SUBSAMPLING_W(EdgeCheck16_AVX2, EDGE_CHECK_PARAMETERS)
+INSTANTIATE_SUBSAMPLING_W(Search16_AVX2, SEARCH_PARAMETERS)
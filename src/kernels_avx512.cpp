@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <climits>
+
+#include <immintrin.h>
+
+#include "kernels.h"
+
+
+// The maskz forms keep GCC 12's headers from warning about uninitialised
+// variables.
+static FORCE_INLINE __m512i Min32(__m512i a, __m512i b) {
+    return _mm512_maskz_min_epi32(0xffff, a, b);
+}
+
+
+// Keeps the keys of the blocks whose search stops here. Returns true when
+// all of them have stopped.
+static FORCE_INLINE bool Stop8(__m512i mMiniKey, __m512i mStopKey, __mmask16 &done, __m512i &mDoneKey) {
+    __mmask16 stop = _mm512_mask_cmplt_epi32_mask((__mmask16)~done, mMiniKey, mStopKey);
+
+    mDoneKey = _mm512_mask_mov_epi32(mDoneKey, stop, mMiniKey);
+    done |= stop;
+
+    return done == 0xffff;
+}
+
+
+// Keeps the keys of the blocks whose search stops here. Returns true when
+// all of them have stopped.
+static FORCE_INLINE bool Stop4(__m256i mMiniKey, __m256i mStopKey, __m256i &mDone, __m256i &mDoneKey) {
+    __m256i mStop = _mm256_andnot_si256(mDone, _mm256_cmpgt_epi32(mStopKey, mMiniKey));
+
+    mDoneKey = _mm256_or_si256(mDoneKey, _mm256_and_si256(mStop, mMiniKey));
+    mDone = _mm256_or_si256(mDone, mStop);
+
+    return _mm256_movemask_epi8(mDone) == -1;
+}
+
+
+static FORCE_INLINE __m512i Load512(const uint8_t *pSrc) {
+    return _mm512_loadu_si512((const void *)pSrc);
+}
+
+
+static FORCE_INLINE __m256i Load256(const uint8_t *pSrc) {
+    return _mm256_loadu_si256((const __m256i *)pSrc);
+}
+
+
+// The sums of absolute differences of the 8 blocks from pDiff0 and pDiff1,
+// in the low 32 bits of each 64.
+template <int subSamplingW>
+static FORCE_INLINE __m512i SadBlocks8(const uint8_t *pDiff0, const uint8_t *pDiff1);
+
+
+template <>
+FORCE_INLINE __m512i SadBlocks8<0>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    return _mm512_sad_epu8(_mm512_maskz_cvtepu32_epi64(0xff, Load256(pDiff0)), _mm512_maskz_cvtepu32_epi64(0xff, Load256(pDiff1)));
+}
+
+
+template <>
+FORCE_INLINE __m512i SadBlocks8<1>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    return _mm512_sad_epu8(Load512(pDiff0), Load512(pDiff1));
+}
+
+
+template <>
+FORCE_INLINE __m512i SadBlocks8<2>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    __m512i mSad0123 = _mm512_sad_epu8(Load512(pDiff0), Load512(pDiff1));
+    __m512i mSad4567 = _mm512_sad_epu8(Load512(pDiff0 + 64), Load512(pDiff1 + 64));
+
+    return _mm512_add_epi64(_mm512_permutex2var_epi64(mSad0123, _mm512_setr_epi64(0, 2, 4, 6, 8, 10, 12, 14), mSad4567),
+                            _mm512_permutex2var_epi64(mSad0123, _mm512_setr_epi64(1, 3, 5, 7, 9, 11, 13, 15), mSad4567));
+}
+
+
+// The same for 4 blocks.
+template <int subSamplingW>
+static FORCE_INLINE __m256i SadBlocks4(const uint8_t *pDiff0, const uint8_t *pDiff1);
+
+
+template <>
+FORCE_INLINE __m256i SadBlocks4<0>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    return _mm256_sad_epu8(_mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)pDiff0)),
+                           _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)pDiff1)));
+}
+
+
+template <>
+FORCE_INLINE __m256i SadBlocks4<1>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    return _mm256_sad_epu8(Load256(pDiff0), Load256(pDiff1));
+}
+
+
+template <>
+FORCE_INLINE __m256i SadBlocks4<2>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    __m256i mSad01 = _mm256_sad_epu8(Load256(pDiff0), Load256(pDiff1));
+    __m256i mSad23 = _mm256_sad_epu8(Load256(pDiff0 + 32), Load256(pDiff1 + 32));
+
+    // Blocks 0 2 1 3.
+    __m256i mSad = _mm256_add_epi64(_mm256_unpacklo_epi64(mSad01, mSad23), _mm256_unpackhi_epi64(mSad01, mSad23));
+
+    return _mm256_permute4x64_epi64(mSad, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+
+// Return the sums shifted into place for SAD_KEY().
+template <int subSamplingW>
+static FORCE_INLINE __m512i Diff8(const uint8_t * const *pLumaRows, const DeCrossCandidate &cand, int nXLuma) {
+    return _mm512_maskz_slli_epi32(0xffff, SadBlocks8<subSamplingW>(&pLumaRows[cand.nLumaRef][nXLuma + cand.nShift], &pLumaRows[cand.nLumaCur][nXLuma]), 8);
+}
+
+
+template <int subSamplingW>
+static FORCE_INLINE __m256i Diff4(const uint8_t * const *pLumaRows, const DeCrossCandidate &cand, int nXLuma) {
+    return _mm256_slli_epi32(SadBlocks4<subSamplingW>(&pLumaRows[cand.nLumaRef][nXLuma + cand.nShift], &pLumaRows[cand.nLumaCur][nXLuma]), 8);
+}
+
+
+// Eight neighbouring blocks per iteration, then four, each in 64 bits of
+// the sums.
+template <int subSamplingW>
+void Search_AVX512(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest) {
+    const DeCrossCandidate *pCandidates = pOrder->candidates;
+
+    int nX = nXStart;
+
+    for ( ; nX < nXEnd && nX + 32 + SEARCH_REACH(subSamplingW) <= nRowSizeU; nX += 32) {
+        int nBlock = nX / 4;
+        int nXLuma = nX << subSamplingW;
+
+        __m512i mMiniKey = _mm512_set1_epi32(SAD_KEY(nNoiseThreshold, 0));
+        __m512i mNextKey = _mm512_set1_epi32(INT_MAX);
+
+        bool bLoad = CanLoadKeys(pShared, nBlock, 8);
+        if (bLoad)
+            mMiniKey = Min32(mMiniKey, _mm512_maskz_cvtepu32_epi64(0xff, _mm256_loadu_si256((const __m256i *)LoadKeys(pShared, nBlock))));
+
+        int c = 0;
+
+        for ( ; c < pOrder->nForwarded; c++) {
+            __m512i mDiff = Diff8<subSamplingW>(pLumaRows, pCandidates[c], nXLuma);
+
+            mMiniKey = Min32(mMiniKey, _mm512_or_si512(mDiff, _mm512_set1_epi32(pCandidates[c].nIndex)));
+            mNextKey = Min32(mNextKey, _mm512_or_si512(mDiff, _mm512_set1_epi32(pCandidates[c].nNext)));
+        }
+
+        __m512i mStopKey = _mm512_set1_epi32(pOrder->nStopKey);
+        __m512i mDoneKey = _mm512_setzero_si512();
+        __mmask16 done = 0;
+
+        for (int nEnd = bLoad ? pOrder->nUncovered : pOrder->nCandidates; c < nEnd; ) {
+            for (int nStep = std::min(c + pOrder->nStopStep, nEnd); c < nStep; c++)
+                mMiniKey = Min32(mMiniKey, _mm512_or_si512(Diff8<subSamplingW>(pLumaRows, pCandidates[c], nXLuma), _mm512_set1_epi32(pCandidates[c].nIndex)));
+
+            if (Stop8(mMiniKey, mStopKey, done, mDoneKey))
+                break;
+        }
+
+        mMiniKey = _mm512_mask_mov_epi32(mMiniKey, done, mDoneKey);
+
+        if (pShared)
+            _mm256_storeu_si256((__m256i *)StoreKeys(pShared, nBlock, 8), _mm512_maskz_cvtepi64_epi32(0xff, mNextKey));
+
+        alignas(64) int nMiniKey[16];
+        _mm512_store_si512((void *)nMiniKey, mMiniKey);
+
+        for (int i = 0; i < 8; i++)
+            pBest[nBlock + i] = BestCandidate(nMiniKey[i * 2], nNoiseThreshold);
+    }
+
+    for ( ; nX < nXEnd && nX + 16 + SEARCH_REACH(subSamplingW) <= nRowSizeU; nX += 16) {
+        int nBlock = nX / 4;
+        int nXLuma = nX << subSamplingW;
+
+        __m256i mMiniKey = _mm256_set1_epi32(SAD_KEY(nNoiseThreshold, 0));
+        __m256i mNextKey = _mm256_set1_epi32(INT_MAX);
+
+        bool bLoad = CanLoadKeys(pShared, nBlock, 4);
+        if (bLoad)
+            mMiniKey = _mm256_min_epi32(mMiniKey, _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)LoadKeys(pShared, nBlock))));
+
+        int c = 0;
+
+        for ( ; c < pOrder->nForwarded; c++) {
+            __m256i mDiff = Diff4<subSamplingW>(pLumaRows, pCandidates[c], nXLuma);
+
+            mMiniKey = _mm256_min_epi32(mMiniKey, _mm256_or_si256(mDiff, _mm256_set1_epi32(pCandidates[c].nIndex)));
+            mNextKey = _mm256_min_epi32(mNextKey, _mm256_or_si256(mDiff, _mm256_set1_epi32(pCandidates[c].nNext)));
+        }
+
+        __m256i mStopKey = _mm256_set1_epi32(pOrder->nStopKey);
+        __m256i mDone = _mm256_setzero_si256();
+        __m256i mDoneKey = _mm256_setzero_si256();
+
+        for (int nEnd = bLoad ? pOrder->nUncovered : pOrder->nCandidates; c < nEnd; ) {
+            for (int nStep = std::min(c + pOrder->nStopStep, nEnd); c < nStep; c++)
+                mMiniKey = _mm256_min_epi32(mMiniKey, _mm256_or_si256(Diff4<subSamplingW>(pLumaRows, pCandidates[c], nXLuma), _mm256_set1_epi32(pCandidates[c].nIndex)));
+
+            if (Stop4(mMiniKey, mStopKey, mDone, mDoneKey))
+                break;
+        }
+
+        mMiniKey = _mm256_blendv_epi8(mMiniKey, mDoneKey, mDone);
+
+        if (pShared)
+            _mm_storeu_si128((__m128i *)StoreKeys(pShared, nBlock, 4), _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(mNextKey, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6))));
+
+        alignas(32) int nMiniKey[8];
+        _mm256_store_si256((__m256i *)nMiniKey, mMiniKey);
+
+        for (int i = 0; i < 4; i++)
+            pBest[nBlock + i] = BestCandidate(nMiniKey[i * 2], nNoiseThreshold);
+    }
+
+    for ( ; nX < nXEnd; nX += 4)
+        SearchBlock_SSE2<subSamplingW>(pLumaRows, pOrder, nX, nNoiseThreshold, pShared, pBest);
+}
+
+
+INSTANTIATE_SUBSAMPLING_W(Search_AVX512, SEARCH_PARAMETERS)
@@ -0,0 +1,614 @@
+#include <algorithm>
+#include <climits>
+
+#include <emmintrin.h>
+
+#include "kernels.h"
+
+
+// Byte i of the result is set if any of bytes i - nBytes to i of mEdge is.
+template <int nBytes>
+static FORCE_INLINE __m128i Spread(__m128i mEdge) {
+    return _mm_or_si128(_mm_slli_si128(mEdge, nBytes), Spread<nBytes - 1>(mEdge));
+}
+
+
+template <>
+FORCE_INLINE __m128i Spread<0>(__m128i mEdge) {
+    return mEdge;
+}
+
+
+// Adds the flags of the 4 chroma pixels at nX, the low 4 bytes of mEdge, to
+// mCarry, which holds those of the pixels from nX - nMargin on, and stores
+// the 4 pixels no later block reaches. The edge buffer is written once
+// instead of being read and written back for every offset in the margin.
+template <int nMargin>
+static FORCE_INLINE void StoreEdges(uint8_t *pEdgeBuffer, int nX, __m128i mEdge, __m128i &mCarry) {
+    mCarry = _mm_or_si128(mCarry, Spread<2 * nMargin>(_mm_cvtsi32_si128(_mm_cvtsi128_si32(mEdge))));
+
+    *(int *)&pEdgeBuffer[nX - nMargin] = _mm_cvtsi128_si32(mCarry);
+    mCarry = _mm_srli_si128(mCarry, 4);
+}
+
+
+// Loads the 4 << subSamplingW luma pixels of a block.
+template <int subSamplingW>
+static FORCE_INLINE __m128i LoadBlock(const uint8_t *pSrc);
+
+
+template <>
+FORCE_INLINE __m128i LoadBlock<0>(const uint8_t *pSrc) {
+    return _mm_cvtsi32_si128(*(const int *)pSrc);
+}
+
+
+template <>
+FORCE_INLINE __m128i LoadBlock<1>(const uint8_t *pSrc) {
+    return _mm_loadl_epi64((const __m128i *)pSrc);
+}
+
+
+template <>
+FORCE_INLINE __m128i LoadBlock<2>(const uint8_t *pSrc) {
+    return _mm_loadu_si128((const __m128i *)pSrc);
+}
+
+
+// Packs the edge flags of the luma pixels into one byte per chroma pixel.
+// The signed saturation keeps every nonzero group nonzero.
+template <int subSamplingW>
+static FORCE_INLINE __m128i PackEdges(__m128i mEdge);
+
+
+template <>
+FORCE_INLINE __m128i PackEdges<0>(__m128i mEdge) {
+    return mEdge;
+}
+
+
+template <>
+FORCE_INLINE __m128i PackEdges<1>(__m128i mEdge) {
+    return _mm_packs_epi16(mEdge, mEdge);
+}
+
+
+template <>
+FORCE_INLINE __m128i PackEdges<2>(__m128i mEdge) {
+    mEdge = _mm_packs_epi32(mEdge, mEdge);
+    return _mm_packs_epi16(mEdge, mEdge);
+}
+
+
+template <int subSamplingW, int nMargin>
+static void EdgeCheckMargin_SSE2(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold) {
+    __m128i mYThreshold = _mm_set1_epi8(nYThreshold - 128);
+    __m128i bytes_128 = _mm_set1_epi8(128);
+    __m128i mCarry = _mm_setzero_si128();
+
+    int nX = 4;
+
+    for ( ; nX < nRowSizeU - 4; nX += 4) {
+        int nXLuma = nX << subSamplingW;
+
+        __m128i mLeft   = LoadBlock<subSamplingW>(&pSrc[nXLuma - 1]);
+        __m128i mCenter = LoadBlock<subSamplingW>(&pSrc[nXLuma]);
+        __m128i mRight  = LoadBlock<subSamplingW>(&pSrc[nXLuma + 1]);
+
+        __m128i mLeft_128 = _mm_sub_epi8(mLeft, bytes_128);
+        __m128i mCenter_128 = _mm_sub_epi8(mCenter, bytes_128);
+        __m128i mRight_128 = _mm_sub_epi8(mRight, bytes_128);
+
+        __m128i abs_diff_left_right = _mm_or_si128(_mm_subs_epu8(mLeft, mRight),
+                                                   _mm_subs_epu8(mRight, mLeft));
+        abs_diff_left_right = _mm_sub_epi8(abs_diff_left_right, bytes_128);
+
+        __m128i mEdge = _mm_and_si128(_mm_cmpgt_epi8(abs_diff_left_right, mYThreshold),
+                                      _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi8(mCenter_128, mLeft_128),
+                                                                 _mm_cmpgt_epi8(mRight_128, mCenter_128)),
+                                                   _mm_and_si128(_mm_cmpgt_epi8(mLeft_128, mCenter_128),
+                                                                 _mm_cmpgt_epi8(mCenter_128, mRight_128))));
+
+        StoreEdges<nMargin>(pEdgeBuffer, nX, PackEdges<subSamplingW>(mEdge), mCarry);
+    }
+
+    _mm_storeu_si128((__m128i *)&pEdgeBuffer[nX - nMargin], mCarry);
+}
+
+
+template <int subSamplingW>
+void EdgeCheck_SSE2(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin) {
+    DISPATCH_MARGIN(nMargin, EdgeCheckMargin_SSE2, subSamplingW, (pSrc, pEdgeBuffer, nRowSizeU, nYThreshold));
+}
+
+
+static FORCE_INLINE __m128i Min32(__m128i a, __m128i b) {
+    __m128i mLess = _mm_cmplt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(mLess, a), _mm_andnot_si128(mLess, b));
+}
+
+
+// Keeps the keys of the blocks whose search stops here. Returns true when
+// all of them have stopped.
+static FORCE_INLINE bool Stop(__m128i mMiniKey, __m128i mStopKey, __m128i &mDone, __m128i &mDoneKey) {
+    __m128i mStop = _mm_andnot_si128(mDone, _mm_cmplt_epi32(mMiniKey, mStopKey));
+
+    mDoneKey = _mm_or_si128(mDoneKey, _mm_and_si128(mStop, mMiniKey));
+    mDone = _mm_or_si128(mDone, mStop);
+
+    return _mm_movemask_epi8(mDone) == 0xffff;
+}
+
+
+// The sum of absolute differences of the block at pDiff0 and pDiff1, in
+// the low 32 bits.
+template <int subSamplingW>
+static FORCE_INLINE __m128i SadBlock(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    __m128i mSad = _mm_sad_epu8(LoadBlock<subSamplingW>(pDiff0), LoadBlock<subSamplingW>(pDiff1));
+
+    if (subSamplingW == 2)
+        mSad = _mm_add_epi32(mSad, _mm_srli_si128(mSad, 8));
+
+    return mSad;
+}
+
+
+// The sums of the two blocks from pDiff0 and pDiff1, in the low 32 bits of
+// each 64.
+template <int subSamplingW>
+static FORCE_INLINE __m128i SadBlocks2(const uint8_t *pDiff0, const uint8_t *pDiff1);
+
+
+template <>
+FORCE_INLINE __m128i SadBlocks2<0>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    __m128i zeroes = _mm_setzero_si128();
+
+    return _mm_sad_epu8(_mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i *)pDiff0), zeroes),
+                        _mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i *)pDiff1), zeroes));
+}
+
+
+template <>
+FORCE_INLINE __m128i SadBlocks2<1>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    return _mm_sad_epu8(_mm_loadu_si128((const __m128i *)pDiff0), _mm_loadu_si128((const __m128i *)pDiff1));
+}
+
+
+template <>
+FORCE_INLINE __m128i SadBlocks2<2>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    __m128i mSad0 = SadBlocks2<1>(pDiff0, pDiff1);
+    __m128i mSad1 = SadBlocks2<1>(pDiff0 + 16, pDiff1 + 16);
+
+    return _mm_add_epi64(_mm_unpacklo_epi64(mSad0, mSad1), _mm_unpackhi_epi64(mSad0, mSad1));
+}
+
+
+// Returns the sums shifted into place for SAD_KEY().
+template <int subSamplingW>
+static FORCE_INLINE __m128i Diff1(const uint8_t * const *pLumaRows, const DeCrossCandidate &cand, int nXLuma) {
+    return _mm_slli_epi32(SadBlock<subSamplingW>(&pLumaRows[cand.nLumaRef][nXLuma + cand.nShift], &pLumaRows[cand.nLumaCur][nXLuma]), 8);
+}
+
+
+template <int subSamplingW>
+static FORCE_INLINE __m128i Diff2(const uint8_t * const *pLumaRows, const DeCrossCandidate &cand, int nXLuma) {
+    return _mm_slli_epi32(SadBlocks2<subSamplingW>(&pLumaRows[cand.nLumaRef][nXLuma + cand.nShift], &pLumaRows[cand.nLumaCur][nXLuma]), 8);
+}
+
+
+template <int subSamplingW>
+void SearchBlock_SSE2(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nX, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest) {
+    const DeCrossCandidate *pCandidates = pOrder->candidates;
+
+    int nBlock = nX / 4;
+    int nXLuma = nX << subSamplingW;
+    int nMiniKey = SAD_KEY(nNoiseThreshold, 0);
+    int nNextKey = INT_MAX;
+
+    bool bLoad = CanLoadKeys(pShared, nBlock, 1);
+    if (bLoad)
+        nMiniKey = std::min(nMiniKey, *LoadKeys(pShared, nBlock));
+
+    int c = 0;
+
+    for ( ; c < pOrder->nForwarded; c++) {
+        int nDiff = _mm_cvtsi128_si32(Diff1<subSamplingW>(pLumaRows, pCandidates[c], nXLuma));
+
+        nMiniKey = std::min(nMiniKey, nDiff | pCandidates[c].nIndex);
+        nNextKey = std::min(nNextKey, nDiff | pCandidates[c].nNext);
+    }
+
+    for (int nEnd = bLoad ? pOrder->nUncovered : pOrder->nCandidates; c < nEnd; ) {
+        for (int nStep = std::min(c + pOrder->nStopStep, nEnd); c < nStep; c++)
+            nMiniKey = std::min(nMiniKey, _mm_cvtsi128_si32(Diff1<subSamplingW>(pLumaRows, pCandidates[c], nXLuma)) | pCandidates[c].nIndex);
+
+        if (nMiniKey < pOrder->nStopKey)
+            break;
+    }
+
+    if (pShared)
+        *StoreKeys(pShared, nBlock, 1) = nNextKey;
+
+    pBest[nBlock] = BestCandidate(nMiniKey, nNoiseThreshold);
+}
+
+
+// Two neighbouring blocks per iteration, each in 64 bits of the sums.
+template <int subSamplingW>
+void Search_SSE2(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest) {
+    const DeCrossCandidate *pCandidates = pOrder->candidates;
+    const __m128i zeroes = _mm_setzero_si128();
+
+    int nX = nXStart;
+
+    for ( ; nX < nXEnd && nX + 8 + SEARCH_REACH(subSamplingW) <= nRowSizeU; nX += 8) {
+        int nBlock = nX / 4;
+        int nXLuma = nX << subSamplingW;
+
+        __m128i mMiniKey = _mm_set1_epi32(SAD_KEY(nNoiseThreshold, 0));
+        __m128i mNextKey = _mm_set1_epi32(INT_MAX);
+
+        bool bLoad = CanLoadKeys(pShared, nBlock, 2);
+        if (bLoad)
+            mMiniKey = Min32(mMiniKey, _mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i *)LoadKeys(pShared, nBlock)), zeroes));
+
+        int c = 0;
+
+        for ( ; c < pOrder->nForwarded; c++) {
+            __m128i mDiff = Diff2<subSamplingW>(pLumaRows, pCandidates[c], nXLuma);
+
+            mMiniKey = Min32(mMiniKey, _mm_or_si128(mDiff, _mm_set1_epi32(pCandidates[c].nIndex)));
+            mNextKey = Min32(mNextKey, _mm_or_si128(mDiff, _mm_set1_epi32(pCandidates[c].nNext)));
+        }
+
+        __m128i mStopKey = _mm_set1_epi32(pOrder->nStopKey);
+        __m128i mDone = zeroes;
+        __m128i mDoneKey = zeroes;
+
+        for (int nEnd = bLoad ? pOrder->nUncovered : pOrder->nCandidates; c < nEnd; ) {
+            for (int nStep = std::min(c + pOrder->nStopStep, nEnd); c < nStep; c++)
+                mMiniKey = Min32(mMiniKey, _mm_or_si128(Diff2<subSamplingW>(pLumaRows, pCandidates[c], nXLuma), _mm_set1_epi32(pCandidates[c].nIndex)));
+
+            if (Stop(mMiniKey, mStopKey, mDone, mDoneKey))
+                break;
+        }
+
+        mMiniKey = _mm_or_si128(_mm_and_si128(mDone, mDoneKey), _mm_andnot_si128(mDone, mMiniKey));
+
+        if (pShared)
+            _mm_storel_epi64((__m128i *)StoreKeys(pShared, nBlock, 2), _mm_shuffle_epi32(mNextKey, _MM_SHUFFLE(3, 1, 2, 0)));
+
+        pBest[nBlock] = BestCandidate(_mm_cvtsi128_si32(mMiniKey), nNoiseThreshold);
+        pBest[nBlock + 1] = BestCandidate(_mm_cvtsi128_si32(_mm_srli_si128(mMiniKey, 8)), nNoiseThreshold);
+    }
+
+    for ( ; nX < nXEnd; nX += 4)
+        SearchBlock_SSE2<subSamplingW>(pLumaRows, pOrder, nX, nNoiseThreshold, pShared, pBest);
+}
+
+
+void AverageChroma_SSE2(const uint8_t *pSrcU, const uint8_t *pSrcV, const uint8_t *pSrcUMini, const uint8_t *pSrcVMini, uint8_t *pDestU, uint8_t *pDestV, const uint8_t *pEdgeBuffer, int nX) {
+    __m128i mSrcU = _mm_cvtsi32_si128(*(const int *)&pSrcU[nX]);
+    __m128i mSrcV = _mm_cvtsi32_si128(*(const int *)&pSrcV[nX]);
+
+    __m128i mSrcUMini = _mm_cvtsi32_si128(*(const int *)&pSrcUMini[nX]);
+    __m128i mSrcVMini = _mm_cvtsi32_si128(*(const int *)&pSrcVMini[nX]);
+
+    __m128i mEdge = _mm_cvtsi32_si128(*(const int *)&pEdgeBuffer[nX]);
+
+    __m128i mBlendColorU = _mm_avg_epu8(mSrcU, mSrcUMini);
+    __m128i mBlendColorV = _mm_avg_epu8(mSrcV, mSrcVMini);
+
+    __m128i mask = _mm_cmpeq_epi8(mEdge, _mm_setzero_si128());
+
+    __m128i mDestU = _mm_or_si128(_mm_and_si128(mask, mSrcU),
+                                  _mm_andnot_si128(mask, mBlendColorU));
+    __m128i mDestV = _mm_or_si128(_mm_and_si128(mask, mSrcV),
+                                  _mm_andnot_si128(mask, mBlendColorV));
+
+    *(int *)&pDestU[nX] = _mm_cvtsi128_si32(mDestU);
+    *(int *)&pDestV[nX] = _mm_cvtsi128_si32(mDestV);
+}
+
+
+// The 16 bit kernels. Unsigned words are compared as signed ones with
+// their top bit flipped.
+
+// The edge flags of the luma pixels from nXLuma on, one per word. Loads
+// 4 pixels if bHalf, 8 otherwise.
+template <bool bHalf>
+static FORCE_INLINE __m128i LumaEdges16(const uint8_t *pSrc, int nXLuma, __m128i mYThreshold) {
+    __m128i words_32768 = _mm_set1_epi16(-32768);
+
+    __m128i mLeft, mCenter, mRight;
+
+    if (bHalf) {
+        mLeft   = _mm_loadl_epi64((const __m128i *)&pSrc[(nXLuma - 1) * 2]);
+        mCenter = _mm_loadl_epi64((const __m128i *)&pSrc[nXLuma * 2]);
+        mRight  = _mm_loadl_epi64((const __m128i *)&pSrc[(nXLuma + 1) * 2]);
+    } else {
+        mLeft   = _mm_loadu_si128((const __m128i *)&pSrc[(nXLuma - 1) * 2]);
+        mCenter = _mm_loadu_si128((const __m128i *)&pSrc[nXLuma * 2]);
+        mRight  = _mm_loadu_si128((const __m128i *)&pSrc[(nXLuma + 1) * 2]);
+    }
+
+    __m128i mLeft_32768 = _mm_xor_si128(mLeft, words_32768);
+    __m128i mCenter_32768 = _mm_xor_si128(mCenter, words_32768);
+    __m128i mRight_32768 = _mm_xor_si128(mRight, words_32768);
+
+    __m128i abs_diff_left_right = _mm_or_si128(_mm_subs_epu16(mLeft, mRight),
+                                               _mm_subs_epu16(mRight, mLeft));
+    abs_diff_left_right = _mm_xor_si128(abs_diff_left_right, words_32768);
+
+    return _mm_and_si128(_mm_cmpgt_epi16(abs_diff_left_right, mYThreshold),
+                         _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi16(mCenter_32768, mLeft_32768),
+                                                    _mm_cmpgt_epi16(mRight_32768, mCenter_32768)),
+                                      _mm_and_si128(_mm_cmpgt_epi16(mLeft_32768, mCenter_32768),
+                                                    _mm_cmpgt_epi16(mCenter_32768, mRight_32768))));
+}
+
+
+// The edge flags of the block of 4 chroma pixels whose luma starts at
+// nXLuma, one byte per chroma pixel.
+template <int subSamplingW>
+static FORCE_INLINE __m128i ChromaEdges16(const uint8_t *pSrc, int nXLuma, __m128i mYThreshold);
+
+
+template <>
+FORCE_INLINE __m128i ChromaEdges16<0>(const uint8_t *pSrc, int nXLuma, __m128i mYThreshold) {
+    __m128i mEdge = LumaEdges16<true>(pSrc, nXLuma, mYThreshold);
+
+    return _mm_packs_epi16(mEdge, mEdge);
+}
+
+
+template <>
+FORCE_INLINE __m128i ChromaEdges16<1>(const uint8_t *pSrc, int nXLuma, __m128i mYThreshold) {
+    __m128i mEdge = LumaEdges16<false>(pSrc, nXLuma, mYThreshold);
+
+    // One byte per pair of luma pixels.
+    mEdge = _mm_packs_epi32(mEdge, mEdge);
+    return _mm_packs_epi16(mEdge, mEdge);
+}
+
+
+template <>
+FORCE_INLINE __m128i ChromaEdges16<2>(const uint8_t *pSrc, int nXLuma, __m128i mYThreshold) {
+    __m128i mEdge = _mm_packs_epi32(LumaEdges16<false>(pSrc, nXLuma, mYThreshold),
+                                    LumaEdges16<false>(pSrc, nXLuma + 8, mYThreshold));
+
+    // One word per pair of luma pixels, then one byte per 4.
+    mEdge = _mm_packs_epi32(mEdge, mEdge);
+    return _mm_packs_epi16(mEdge, mEdge);
+}
+
+
+template <int subSamplingW, int nMargin>
+static void EdgeCheckMargin16_SSE2(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold) {
+    __m128i mYThreshold = _mm_set1_epi16((int16_t)(nYThreshold - 32768));
+    __m128i mCarry = _mm_setzero_si128();
+
+    int nX = 4;
+
+    for ( ; nX < nRowSizeU - 4; nX += 4)
+        StoreEdges<nMargin>(pEdgeBuffer, nX, ChromaEdges16<subSamplingW>(pSrc, nX << subSamplingW, mYThreshold), mCarry);
+
+    _mm_storeu_si128((__m128i *)&pEdgeBuffer[nX - nMargin], mCarry);
+}
+
+
+template <int subSamplingW>
+void EdgeCheck16_SSE2(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin) {
+    DISPATCH_MARGIN(nMargin, EdgeCheckMargin16_SSE2, subSamplingW, (pSrc, pEdgeBuffer, nRowSizeU, nYThreshold));
+}
+
+
+// The sums of pairs of absolute differences over the 8 luma pixels of a
+// block, each less 65536, so they fit _mm_madd_epi16.
+static FORCE_INLINE __m128i PairSums16(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    __m128i mDiff0 = _mm_loadu_si128((const __m128i *)pDiff0);
+    __m128i mDiff1 = _mm_loadu_si128((const __m128i *)pDiff1);
+
+    __m128i mAbsDiff = _mm_or_si128(_mm_subs_epu16(mDiff0, mDiff1), _mm_subs_epu16(mDiff1, mDiff0));
+
+    return _mm_madd_epi16(_mm_xor_si128(mAbsDiff, _mm_set1_epi16(-32768)), _mm_set1_epi16(1));
+}
+
+
+// Undoes the bias of PairSums16() over nWords words and shifts the sums
+// into place for SAD_KEY().
+template <int nWords>
+static FORCE_INLINE __m128i Key16(__m128i mSums) {
+    return _mm_slli_epi32(_mm_add_epi32(mSums, _mm_set1_epi32(nWords * 32768)), 8);
+}
+
+
+// The words BlockPairSums16() biases, which include the 4 zero words above
+// a block of 4 luma pixels.
+#define BLOCK_WORDS_16(subSamplingW) ((subSamplingW) ? 4 << (subSamplingW) : 8)
+
+
+// The pair sums of the block at pDiff0 and pDiff1, biased over
+// BLOCK_WORDS_16() words.
+template <int subSamplingW>
+static FORCE_INLINE __m128i BlockPairSums16(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    if (subSamplingW == 0) {
+        __m128i mDiff0 = _mm_loadl_epi64((const __m128i *)pDiff0);
+        __m128i mDiff1 = _mm_loadl_epi64((const __m128i *)pDiff1);
+        __m128i mAbsDiff = _mm_or_si128(_mm_subs_epu16(mDiff0, mDiff1), _mm_subs_epu16(mDiff1, mDiff0));
+
+        return _mm_madd_epi16(_mm_xor_si128(mAbsDiff, _mm_set1_epi16(-32768)), _mm_set1_epi16(1));
+    }
+
+    if (subSamplingW == 2)
+        return _mm_add_epi32(PairSums16(pDiff0, pDiff1), PairSums16(pDiff0 + 16, pDiff1 + 16));
+
+    return PairSums16(pDiff0, pDiff1);
+}
+
+
+template <int subSamplingW>
+static FORCE_INLINE __m128i Diff1_16(const uint8_t * const *pLumaRows, const DeCrossCandidate &cand, int nXLuma) {
+    __m128i mSums = BlockPairSums16<subSamplingW>(&pLumaRows[cand.nLumaRef][(nXLuma + cand.nShift) * 2], &pLumaRows[cand.nLumaCur][nXLuma * 2]);
+
+    mSums = _mm_add_epi32(mSums, _mm_shuffle_epi32(mSums, _MM_SHUFFLE(1, 0, 3, 2)));
+    mSums = _mm_add_epi32(mSums, _mm_shuffle_epi32(mSums, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return Key16<BLOCK_WORDS_16(subSamplingW)>(mSums);
+}
+
+
+// One block per 32 bit element. In 4:4:4 each PairSums16() covers two
+// blocks.
+template <int subSamplingW>
+static FORCE_INLINE __m128i Diff4_16(const uint8_t * const *pLumaRows, const DeCrossCandidate &cand, int nXLuma) {
+    const uint8_t *pDiff0 = &pLumaRows[cand.nLumaRef][(nXLuma + cand.nShift) * 2];
+    const uint8_t *pDiff1 = &pLumaRows[cand.nLumaCur][nXLuma * 2];
+
+    if (subSamplingW == 0) {
+        __m128 mSums0 = _mm_castsi128_ps(PairSums16(pDiff0, pDiff1));
+        __m128 mSums1 = _mm_castsi128_ps(PairSums16(pDiff0 + 16, pDiff1 + 16));
+
+        return Key16<4>(_mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(mSums0, mSums1, _MM_SHUFFLE(2, 0, 2, 0))),
+                                      _mm_castps_si128(_mm_shuffle_ps(mSums0, mSums1, _MM_SHUFFLE(3, 1, 3, 1)))));
+    }
+
+    const int nBlockBytes = 8 << subSamplingW;
+
+    __m128i mSums0 = BlockPairSums16<subSamplingW>(pDiff0, pDiff1);
+    __m128i mSums1 = BlockPairSums16<subSamplingW>(pDiff0 + nBlockBytes, pDiff1 + nBlockBytes);
+    __m128i mSums2 = BlockPairSums16<subSamplingW>(pDiff0 + 2 * nBlockBytes, pDiff1 + 2 * nBlockBytes);
+    __m128i mSums3 = BlockPairSums16<subSamplingW>(pDiff0 + 3 * nBlockBytes, pDiff1 + 3 * nBlockBytes);
+
+    __m128i mSums01 = _mm_add_epi32(_mm_unpacklo_epi32(mSums0, mSums1), _mm_unpackhi_epi32(mSums0, mSums1));
+    __m128i mSums23 = _mm_add_epi32(_mm_unpacklo_epi32(mSums2, mSums3), _mm_unpackhi_epi32(mSums2, mSums3));
+
+    return Key16<BLOCK_WORDS_16(subSamplingW)>(_mm_add_epi32(_mm_unpacklo_epi64(mSums01, mSums23), _mm_unpackhi_epi64(mSums01, mSums23)));
+}
+
+
+template <int subSamplingW>
+void SearchBlock16_SSE2(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nX, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest) {
+    const DeCrossCandidate *pCandidates = pOrder->candidates;
+
+    int nBlock = nX / 4;
+    int nXLuma = nX << subSamplingW;
+    int nMiniKey = SAD_KEY(nNoiseThreshold, 0);
+    int nNextKey = INT_MAX;
+
+    bool bLoad = CanLoadKeys(pShared, nBlock, 1);
+    if (bLoad)
+        nMiniKey = std::min(nMiniKey, *LoadKeys(pShared, nBlock));
+
+    int c = 0;
+
+    for ( ; c < pOrder->nForwarded; c++) {
+        int nDiff = _mm_cvtsi128_si32(Diff1_16<subSamplingW>(pLumaRows, pCandidates[c], nXLuma));
+
+        nMiniKey = std::min(nMiniKey, nDiff | pCandidates[c].nIndex);
+        nNextKey = std::min(nNextKey, nDiff | pCandidates[c].nNext);
+    }
+
+    for (int nEnd = bLoad ? pOrder->nUncovered : pOrder->nCandidates; c < nEnd; ) {
+        for (int nStep = std::min(c + pOrder->nStopStep, nEnd); c < nStep; c++)
+            nMiniKey = std::min(nMiniKey, _mm_cvtsi128_si32(Diff1_16<subSamplingW>(pLumaRows, pCandidates[c], nXLuma)) | pCandidates[c].nIndex);
+
+        if (nMiniKey < pOrder->nStopKey)
+            break;
+    }
+
+    if (pShared)
+        *StoreKeys(pShared, nBlock, 1) = nNextKey;
+
+    pBest[nBlock] = BestCandidate(nMiniKey, nNoiseThreshold);
+}
+
+
+// Four neighbouring blocks per iteration.
+template <int subSamplingW>
+void Search16_SSE2(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest) {
+    const DeCrossCandidate *pCandidates = pOrder->candidates;
+    const __m128i zeroes = _mm_setzero_si128();
+
+    int nX = nXStart;
+
+    for ( ; nX < nXEnd && nX + 16 + SEARCH_REACH(subSamplingW) <= nRowSizeU; nX += 16) {
+        int nBlock = nX / 4;
+        int nXLuma = nX << subSamplingW;
+
+        __m128i mMiniKey = _mm_set1_epi32(SAD_KEY(nNoiseThreshold, 0));
+        __m128i mNextKey = _mm_set1_epi32(INT_MAX);
+
+        bool bLoad = CanLoadKeys(pShared, nBlock, 4);
+        if (bLoad)
+            mMiniKey = Min32(mMiniKey, _mm_loadu_si128((const __m128i *)LoadKeys(pShared, nBlock)));
+
+        int c = 0;
+
+        for ( ; c < pOrder->nForwarded; c++) {
+            __m128i mDiff = Diff4_16<subSamplingW>(pLumaRows, pCandidates[c], nXLuma);
+
+            mMiniKey = Min32(mMiniKey, _mm_or_si128(mDiff, _mm_set1_epi32(pCandidates[c].nIndex)));
+            mNextKey = Min32(mNextKey, _mm_or_si128(mDiff, _mm_set1_epi32(pCandidates[c].nNext)));
+        }
+
+        __m128i mStopKey = _mm_set1_epi32(pOrder->nStopKey);
+        __m128i mDone = zeroes;
+        __m128i mDoneKey = zeroes;
+
+        for (int nEnd = bLoad ? pOrder->nUncovered : pOrder->nCandidates; c < nEnd; ) {
+            for (int nStep = std::min(c + pOrder->nStopStep, nEnd); c < nStep; c++)
+                mMiniKey = Min32(mMiniKey, _mm_or_si128(Diff4_16<subSamplingW>(pLumaRows, pCandidates[c], nXLuma), _mm_set1_epi32(pCandidates[c].nIndex)));
+
+            if (Stop(mMiniKey, mStopKey, mDone, mDoneKey))
+                break;
+        }
+
+        mMiniKey = _mm_or_si128(_mm_and_si128(mDone, mDoneKey), _mm_andnot_si128(mDone, mMiniKey));
+
+        if (pShared)
+            _mm_storeu_si128((__m128i *)StoreKeys(pShared, nBlock, 4), mNextKey);
+
+        alignas(16) int nMiniKey[4];
+        _mm_store_si128((__m128i *)nMiniKey, mMiniKey);
+
+        for (int i = 0; i < 4; i++)
+            pBest[nBlock + i] = BestCandidate(nMiniKey[i], nNoiseThreshold);
+    }
+
+    for ( ; nX < nXEnd; nX += 4)
+        SearchBlock16_SSE2<subSamplingW>(pLumaRows, pOrder, nX, nNoiseThreshold, pShared, pBest);
+}
+
+
+void AverageChroma16_SSE2(const uint8_t *pSrcU, const uint8_t *pSrcV, const uint8_t *pSrcUMini, const uint8_t *pSrcVMini, uint8_t *pDestU, uint8_t *pDestV, const uint8_t *pEdgeBuffer, int nX) {
+    __m128i mSrcU = _mm_loadl_epi64((const __m128i *)&pSrcU[nX * 2]);
+    __m128i mSrcV = _mm_loadl_epi64((const __m128i *)&pSrcV[nX * 2]);
+
+    __m128i mSrcUMini = _mm_loadl_epi64((const __m128i *)&pSrcUMini[nX * 2]);
+    __m128i mSrcVMini = _mm_loadl_epi64((const __m128i *)&pSrcVMini[nX * 2]);
+
+    __m128i mEdge = _mm_cvtsi32_si128(*(const int *)&pEdgeBuffer[nX]);
+    mEdge = _mm_unpacklo_epi8(mEdge, mEdge);
+
+    __m128i mBlendColorU = _mm_avg_epu16(mSrcU, mSrcUMini);
+    __m128i mBlendColorV = _mm_avg_epu16(mSrcV, mSrcVMini);
+
+    __m128i mask = _mm_cmpeq_epi16(mEdge, _mm_setzero_si128());
+
+    __m128i mDestU = _mm_or_si128(_mm_and_si128(mask, mSrcU),
+                                  _mm_andnot_si128(mask, mBlendColorU));
+    __m128i mDestV = _mm_or_si128(_mm_and_si128(mask, mSrcV),
+                                  _mm_andnot_si128(mask, mBlendColorV));
+
+    _mm_storel_epi64((__m128i *)&pDestU[nX * 2], mDestU);
+    _mm_storel_epi64((__m128i *)&pDestV[nX * 2], mDestV);
+}
+
+
+INSTANTIATE_SUBSAMPLING_W(SearchBlock_SSE2, SEARCH_BLOCK_PARAMETERS)
+INSTANTIATE_SUBSAMPLING_W(EdgeCheck_SSE2, EDGE_CHECK_PARAMETERS)
+INSTANTIATE_SUBSAMPLING_W(Search_SSE2, SEARCH_PARAMETERS)
+INSTANTIATE_SUBSAMPLING_W(SearchBlock16_SSE2, SEARCH_BLOCK_PARAMETERS)
+INSTANTIATE_SUBSAMPLING_W(EdgeCheck16_SSE2, EDGE_CHECK_PARAMETERS)
+INSTANTIATE_SUBSAMPLING_W(Search16_SSE2, SEARCH_PARAMETERS)
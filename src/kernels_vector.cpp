@@ -0,0 +1,459 @@
+// The kernels for CPUs without kernels of their own, written with the vector
+// extensions of GCC and Clang so that the compiler picks the instructions.
+// They work like the SSE2 ones and give the same output as C.
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#include "kernels.h"
+
+#if defined (DECROSS_VECTOR)
+
+
+typedef uint8_t VecU8 __attribute__((vector_size(16)));
+typedef uint16_t VecU16 __attribute__((vector_size(16)));
+typedef uint32_t VecU32 __attribute__((vector_size(16)));
+typedef uint64_t VecU64 __attribute__((vector_size(16)));
+typedef int32_t VecI32 __attribute__((vector_size(16)));
+
+// The edge flags of the 4 chroma pixels of a block.
+typedef uint8_t Flags __attribute__((vector_size(4)));
+
+
+template <int nBytes>
+struct UInt;
+
+template <> struct UInt<1> { typedef uint8_t Type; };
+template <> struct UInt<2> { typedef uint16_t Type; };
+template <> struct UInt<4> { typedef uint32_t Type; };
+template <> struct UInt<8> { typedef uint64_t Type; };
+
+
+// The luma of a block, 4 << subSamplingW pixels, in nChunks vectors of at
+// most 16 bytes, which all targets pass the same way. Then the same pixels
+// as sums of pairs and of quads, as one lane per chroma pixel, and the
+// edge flags of those chroma pixels.
+template <typename PixelType, int subSamplingW>
+struct LumaVectors {
+    static const int nBlockBytes = sizeof(PixelType) << (2 + subSamplingW);
+    static const int nBytes = nBlockBytes < 16 ? nBlockBytes : 16;
+    static const int nChunks = nBlockBytes / nBytes;
+    static const int nChunkPixels = nBytes / sizeof(PixelType);
+
+    typedef PixelType Luma __attribute__((vector_size(nBytes)));
+    typedef typename UInt<sizeof(PixelType) * 2>::Type LumaPairs __attribute__((vector_size(nBytes)));
+    typedef typename UInt<sizeof(PixelType) * 4>::Type LumaQuads __attribute__((vector_size(nBytes)));
+    typedef typename UInt<(sizeof(PixelType) << subSamplingW)>::Type LumaGroups __attribute__((vector_size(nBytes)));
+    typedef uint8_t ChunkFlags __attribute__((vector_size(4 / nChunks)));
+};
+
+
+// The chroma of a block, 4 pixels, with a mask of the same size.
+template <typename PixelType>
+struct Vectors;
+
+template <>
+struct Vectors<uint8_t> {
+    typedef uint8_t Chroma __attribute__((vector_size(4)));
+    typedef int8_t ChromaMask __attribute__((vector_size(4)));
+};
+
+template <>
+struct Vectors<uint16_t> {
+    typedef uint16_t Chroma __attribute__((vector_size(8)));
+    typedef int16_t ChromaMask __attribute__((vector_size(8)));
+};
+
+
+template <typename Vector>
+static FORCE_INLINE Vector Load(const void *p) {
+    Vector v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+template <typename Vector>
+static FORCE_INLINE void Store(void *p, Vector v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+
+// As the larger less the smaller, which most CPUs have instructions for.
+template <typename Vector>
+static FORCE_INLINE Vector AbsDiff(Vector a, Vector b) {
+    return (a > b ? a : b) - (a < b ? a : b);
+}
+
+
+// Adds the two halves of every lane of v, giving lanes twice as wide. The
+// sum is the same whatever the byte order.
+template <typename Wide, typename Vector>
+static FORCE_INLINE Wide AddPairs(Vector v) {
+    const int nBits = sizeof(v[0]) * 8;
+    Wide w = (Wide)v;
+
+    return ((w << nBits) >> nBits) + (w >> nBits);
+}
+
+
+template <typename Vector>
+static FORCE_INLINE Vector Min(Vector a, Vector b) {
+    Vector mLess = (Vector)(a < b);
+    return (a & mLess) | (b & ~mLess);
+}
+
+
+// Moves the bytes of x nBytes places towards the higher or the lower
+// addresses, as they are in memory.
+static FORCE_INLINE uint64_t ShiftUp(uint64_t x, int nBytes) {
+#if defined (__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return x >> (nBytes * 8);
+#else
+    return x << (nBytes * 8);
+#endif
+}
+
+
+static FORCE_INLINE uint64_t ShiftDown(uint64_t x, int nBytes) {
+#if defined (__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return x << (nBytes * 8);
+#else
+    return x >> (nBytes * 8);
+#endif
+}
+
+
+// Adds the flags of the 4 chroma pixels at nX to nCarry, which holds those
+// of the 8 pixels from nX - 4 on, stores the 4 pixels no later block
+// reaches and moves on to the next block. Like StoreEdges() of the SSE2
+// kernels, the edge buffer is written once instead of being read and
+// written back for every offset in the margin.
+template <int nMargin>
+static FORCE_INLINE void StoreEdges(uint8_t *pEdgeBuffer, int nX, Flags mFlags, uint64_t &nCarry) {
+    uint64_t nFlags = 0;
+    memcpy(&nFlags, &mFlags, sizeof(mFlags));
+
+    uint64_t nLeft = ShiftUp(nFlags, 4);
+    uint64_t nRight = nFlags;
+
+    for (int i = 1; i <= nMargin; i++) {
+        nLeft |= ShiftUp(nFlags, 4 - i);
+        nRight |= ShiftUp(nFlags, i);
+    }
+
+    nCarry |= nLeft;
+    memcpy(&pEdgeBuffer[nX - 4], &nCarry, 4);
+    nCarry = ShiftDown(nCarry, 4) | nRight;
+}
+
+
+template <typename PixelType, int subSamplingW, int nMargin>
+static FORCE_INLINE void EdgeCheckMargin(const uint8_t *pSrc8, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold) {
+    typedef LumaVectors<PixelType, subSamplingW> Types;
+    typedef typename Types::Luma Luma;
+    typedef typename Types::LumaGroups LumaGroups;
+    typedef typename Types::ChunkFlags ChunkFlags;
+
+    const PixelType *pSrc = (const PixelType *)pSrc8;
+    const Luma mYThreshold = Luma() + (PixelType)nYThreshold;
+    uint64_t nCarry = 0;
+
+    int nX = 4;
+
+    for ( ; nX < nRowSizeU - 4; nX += 4) {
+        Flags mFlags;
+
+        for (int i = 0; i < Types::nChunks; i++) {
+            const PixelType *pChunk = &pSrc[(nX << subSamplingW) + i * Types::nChunkPixels];
+
+            Luma mLeft   = Load<Luma>(pChunk - 1);
+            Luma mCenter = Load<Luma>(pChunk);
+            Luma mRight  = Load<Luma>(pChunk + 1);
+
+            Luma mEdge = (Luma)(AbsDiff(mLeft, mRight) > mYThreshold) &
+                         (((Luma)(mCenter > mLeft) & (Luma)(mRight > mCenter)) |
+                          ((Luma)(mLeft > mCenter) & (Luma)(mCenter > mRight)));
+
+            // One flag per chroma pixel.
+            ChunkFlags mChunkFlags = __builtin_convertvector((LumaGroups)mEdge != 0, ChunkFlags);
+            memcpy((uint8_t *)&mFlags + i * sizeof(mChunkFlags), &mChunkFlags, sizeof(mChunkFlags));
+        }
+
+        StoreEdges<nMargin>(pEdgeBuffer, nX, mFlags, nCarry);
+    }
+
+    memcpy(&pEdgeBuffer[nX - 4], &nCarry, sizeof(nCarry));
+}
+
+
+template <typename PixelType, int subSamplingW>
+static FORCE_INLINE int Diff(const uint8_t * const *pLumaRows, const DeCrossCandidate &cand, int nXLuma) {
+    typedef LumaVectors<PixelType, subSamplingW> Types;
+    typedef typename Types::Luma Luma;
+
+    const PixelType *pDiff0 = (const PixelType *)pLumaRows[cand.nLumaRef] + nXLuma + cand.nShift;
+    const PixelType *pDiff1 = (const PixelType *)pLumaRows[cand.nLumaCur] + nXLuma;
+
+    int nDiff = 0;
+
+    for (int i = 0; i < Types::nChunks; i++) {
+        typename Types::LumaQuads mSums =
+            AddPairs<typename Types::LumaQuads>(
+                AddPairs<typename Types::LumaPairs>(AbsDiff(Load<Luma>(pDiff0 + i * Types::nChunkPixels),
+                                                            Load<Luma>(pDiff1 + i * Types::nChunkPixels))));
+
+        for (size_t j = 0; j < sizeof(mSums) / sizeof(mSums[0]); j++)
+            nDiff += (int)mSums[j];
+    }
+
+    return nDiff;
+}
+
+
+template <typename PixelType, int subSamplingW>
+static FORCE_INLINE void SearchBlock(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nX, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest) {
+    const DeCrossCandidate *pCandidates = pOrder->candidates;
+
+    int nBlock = nX / 4;
+    int nXLuma = nX << subSamplingW;
+    int nMiniKey = SAD_KEY(nNoiseThreshold, 0);
+    int nNextKey = INT_MAX;
+
+    bool bLoad = CanLoadKeys(pShared, nBlock, 1);
+    if (bLoad)
+        nMiniKey = std::min(nMiniKey, *LoadKeys(pShared, nBlock));
+
+    int c = 0;
+
+    for ( ; c < pOrder->nForwarded; c++) {
+        int nDiff = Diff<PixelType, subSamplingW>(pLumaRows, pCandidates[c], nXLuma);
+
+        nMiniKey = std::min(nMiniKey, SAD_KEY(nDiff, pCandidates[c].nIndex));
+        nNextKey = std::min(nNextKey, SAD_KEY(nDiff, pCandidates[c].nNext));
+    }
+
+    for (int nEnd = bLoad ? pOrder->nUncovered : pOrder->nCandidates; c < nEnd; ) {
+        for (int nStep = std::min(c + pOrder->nStopStep, nEnd); c < nStep; c++)
+            nMiniKey = std::min(nMiniKey, SAD_KEY((Diff<PixelType, subSamplingW>(pLumaRows, pCandidates[c], nXLuma)), pCandidates[c].nIndex));
+
+        if (nMiniKey < pOrder->nStopKey)
+            break;
+    }
+
+    if (pShared)
+        *StoreKeys(pShared, nBlock, 1) = nNextKey;
+
+    pBest[nBlock] = BestCandidate(nMiniKey, nNoiseThreshold);
+}
+
+
+// The sums of absolute differences of the 16 luma pixels at pDiff0 and
+// pDiff1, one per 64 bit lane.
+static FORCE_INLINE VecU64 Sums2(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    return AddPairs<VecU64>(AddPairs<VecU32>(AddPairs<VecU16>(AbsDiff(Load<VecU8>(pDiff0), Load<VecU8>(pDiff1)))));
+}
+
+
+// The lane of each block's key in Diff4() in 4:2:2 and 4:2:0, which
+// depends on the byte order.
+#if defined (__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static const int keyLanes[4] = { 1, 3, 0, 2 };
+#else
+static const int keyLanes[4] = { 0, 2, 1, 3 };
+#endif
+
+
+// The other subsamplings keep the blocks in order.
+template <int subSamplingW>
+static FORCE_INLINE int KeyLane(int nBlock) {
+    return subSamplingW == 1 ? keyLanes[nBlock] : nBlock;
+}
+
+
+// The sums of absolute differences of four neighbouring blocks.
+template <int subSamplingW>
+static FORCE_INLINE VecI32 Sums4(const uint8_t *pDiff0, const uint8_t *pDiff1);
+
+
+template <>
+FORCE_INLINE VecI32 Sums4<0>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    return (VecI32)AddPairs<VecU32>(AddPairs<VecU16>(AbsDiff(Load<VecU8>(pDiff0), Load<VecU8>(pDiff1))));
+}
+
+
+// The sums of the last two go in the top halves of the 64 bit lanes of the
+// first two, instead of being moved across lanes, so the blocks' keys are
+// in the lanes keyLanes gives.
+template <>
+FORCE_INLINE VecI32 Sums4<1>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    return (VecI32)(Sums2(pDiff0, pDiff1) | (Sums2(pDiff0 + 16, pDiff1 + 16) << 32));
+}
+
+
+template <>
+FORCE_INLINE VecI32 Sums4<2>(const uint8_t *pDiff0, const uint8_t *pDiff1) {
+    VecI32 mSums;
+
+    for (int i = 0; i < 4; i++) {
+        VecU64 mSums2 = Sums2(pDiff0 + i * 16, pDiff1 + i * 16);
+        mSums[i] = (int)(mSums2[0] + mSums2[1]);
+    }
+
+    return mSums;
+}
+
+
+// Shifted into place for SAD_KEY(), with the blocks' keys in the lanes
+// KeyLane() gives.
+template <int subSamplingW>
+static FORCE_INLINE VecI32 Diff4(const uint8_t * const *pLumaRows, const DeCrossCandidate &cand, int nXLuma) {
+    return Sums4<subSamplingW>(&pLumaRows[cand.nLumaRef][nXLuma + cand.nShift], &pLumaRows[cand.nLumaCur][nXLuma]) << 8;
+}
+
+
+// Four neighbouring blocks at once, like Search16_SSE2().
+template <int subSamplingW>
+void Search_Vector(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest) {
+    const DeCrossCandidate *pCandidates = pOrder->candidates;
+    const VecI32 zeroes = VecI32();
+
+    int nX = nXStart;
+
+    for ( ; nX < nXEnd && nX + 16 + SEARCH_REACH(subSamplingW) <= nRowSizeU; nX += 16) {
+        int nBlock = nX / 4;
+        int nXLuma = nX << subSamplingW;
+
+        VecI32 mMiniKey = zeroes + SAD_KEY(nNoiseThreshold, 0);
+        VecI32 mNextKey = zeroes + INT_MAX;
+
+        bool bLoad = CanLoadKeys(pShared, nBlock, 4);
+        if (bLoad) {
+            const int *pKeys = LoadKeys(pShared, nBlock);
+            VecI32 mKeys;
+            for (int i = 0; i < 4; i++)
+                mKeys[KeyLane<subSamplingW>(i)] = pKeys[i];
+
+            mMiniKey = Min(mMiniKey, mKeys);
+        }
+
+        int c = 0;
+
+        for ( ; c < pOrder->nForwarded; c++) {
+            VecI32 mDiff = Diff4<subSamplingW>(pLumaRows, pCandidates[c], nXLuma);
+
+            mMiniKey = Min(mMiniKey, mDiff | pCandidates[c].nIndex);
+            mNextKey = Min(mNextKey, mDiff | pCandidates[c].nNext);
+        }
+
+        // The keys of the blocks whose search has stopped.
+        VecI32 mDone = zeroes;
+        VecI32 mDoneKey = zeroes;
+
+        for (int nEnd = bLoad ? pOrder->nUncovered : pOrder->nCandidates; c < nEnd; ) {
+            for (int nStep = std::min(c + pOrder->nStopStep, nEnd); c < nStep; c++)
+                mMiniKey = Min(mMiniKey, Diff4<subSamplingW>(pLumaRows, pCandidates[c], nXLuma) | pCandidates[c].nIndex);
+
+            VecI32 mStop = (VecI32)(mMiniKey < pOrder->nStopKey) & ~mDone;
+
+            mDoneKey |= mStop & mMiniKey;
+            mDone |= mStop;
+
+            if (mDone[0] && mDone[1] && mDone[2] && mDone[3])
+                break;
+        }
+
+        mMiniKey = (mDone & mDoneKey) | (~mDone & mMiniKey);
+
+        if (pShared) {
+            int *pKeys = StoreKeys(pShared, nBlock, 4);
+            for (int i = 0; i < 4; i++)
+                pKeys[i] = mNextKey[KeyLane<subSamplingW>(i)];
+        }
+
+        for (int i = 0; i < 4; i++)
+            pBest[nBlock + i] = BestCandidate(mMiniKey[KeyLane<subSamplingW>(i)], nNoiseThreshold);
+    }
+
+    for ( ; nX < nXEnd; nX += 4)
+        SearchBlock<uint8_t, subSamplingW>(pLumaRows, pOrder, nX, nNoiseThreshold, pShared, pBest);
+}
+
+
+// Above 8 bits a block fills a vector, so the blocks are searched one at a
+// time.
+template <int subSamplingW>
+void Search16_Vector(const uint8_t * const *pLumaRows, const DeCrossSearchOrder *pOrder, int nXStart, int nXEnd, int nRowSizeU, int nNoiseThreshold, DeCrossSharedKeys *pShared, int8_t *pBest) {
+    (void)nRowSizeU;
+
+    for (int nX = nXStart; nX < nXEnd; nX += 4)
+        SearchBlock<uint16_t, subSamplingW>(pLumaRows, pOrder, nX, nNoiseThreshold, pShared, pBest);
+}
+
+
+template <typename PixelType>
+static FORCE_INLINE void AverageChroma(const uint8_t *pSrcU, const uint8_t *pSrcV, const uint8_t *pSrcUMini, const uint8_t *pSrcVMini, uint8_t *pDestU, uint8_t *pDestV, const uint8_t *pEdgeBuffer, int nX) {
+    typedef typename Vectors<PixelType>::Chroma Chroma;
+    typedef typename Vectors<PixelType>::ChromaMask ChromaMask;
+
+    const int nOffset = nX * sizeof(PixelType);
+
+    Chroma mSrcU = Load<Chroma>(pSrcU + nOffset);
+    Chroma mSrcV = Load<Chroma>(pSrcV + nOffset);
+    Chroma mSrcUMini = Load<Chroma>(pSrcUMini + nOffset);
+    Chroma mSrcVMini = Load<Chroma>(pSrcVMini + nOffset);
+
+    // (a + b + 1) >> 1 without overflowing.
+    Chroma mBlendColorU = (mSrcU | mSrcUMini) - ((mSrcU ^ mSrcUMini) >> 1);
+    Chroma mBlendColorV = (mSrcV | mSrcVMini) - ((mSrcV ^ mSrcVMini) >> 1);
+
+    Chroma mask = (Chroma)__builtin_convertvector(Load<Flags>(&pEdgeBuffer[nX]) == 0, ChromaMask);
+
+    Store(pDestU + nOffset, (mask & mSrcU) | (~mask & mBlendColorU));
+    Store(pDestV + nOffset, (mask & mSrcV) | (~mask & mBlendColorV));
+}
+
+
+// DISPATCH_MARGIN() takes the subsampling and the margin as the only
+// template parameters.
+template <int subSamplingW, int nMargin>
+static void EdgeCheckMargin_Vector(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold) {
+    EdgeCheckMargin<uint8_t, subSamplingW, nMargin>(pSrc, pEdgeBuffer, nRowSizeU, nYThreshold);
+}
+
+
+template <int subSamplingW, int nMargin>
+static void EdgeCheckMargin16_Vector(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold) {
+    EdgeCheckMargin<uint16_t, subSamplingW, nMargin>(pSrc, pEdgeBuffer, nRowSizeU, nYThreshold);
+}
+
+
+template <int subSamplingW>
+void EdgeCheck_Vector(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin) {
+    DISPATCH_MARGIN(nMargin, EdgeCheckMargin_Vector, subSamplingW, (pSrc, pEdgeBuffer, nRowSizeU, nYThreshold));
+}
+
+
+void AverageChroma_Vector(const uint8_t *pSrcU, const uint8_t *pSrcV, const uint8_t *pSrcUMini, const uint8_t *pSrcVMini, uint8_t *pDestU, uint8_t *pDestV, const uint8_t *pEdgeBuffer, int nX) {
+    AverageChroma<uint8_t>(pSrcU, pSrcV, pSrcUMini, pSrcVMini, pDestU, pDestV, pEdgeBuffer, nX);
+}
+
+
+template <int subSamplingW>
+void EdgeCheck16_Vector(const uint8_t *pSrc, uint8_t *pEdgeBuffer, int nRowSizeU, int nYThreshold, int nMargin) {
+    DISPATCH_MARGIN(nMargin, EdgeCheckMargin16_Vector, subSamplingW, (pSrc, pEdgeBuffer, nRowSizeU, nYThreshold));
+}
+
+
+void AverageChroma16_Vector(const uint8_t *pSrcU, const uint8_t *pSrcV, const uint8_t *pSrcUMini, const uint8_t *pSrcVMini, uint8_t *pDestU, uint8_t *pDestV, const uint8_t *pEdgeBuffer, int nX) {
+    AverageChroma<uint16_t>(pSrcU, pSrcV, pSrcUMini, pSrcVMini, pDestU, pDestV, pEdgeBuffer, nX);
+}
+
+
+INSTANTIATE_SUBSAMPLING_W(EdgeCheck_Vector, EDGE_CHECK_PARAMETERS)
+INSTANTIATE_SUBSAMPLING_W(Search_Vector, SEARCH_PARAMETERS)
+INSTANTIATE_SUBSAMPLING_W(EdgeCheck16_Vector, EDGE_CHECK_PARAMETERS)
+INSTANTIATE_SUBSAMPLING_W(Search16_Vector, SEARCH_PARAMETERS)
+
+#endif // DECROSS_VECTOR
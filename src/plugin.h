@@ -0,0 +1,289 @@
+#ifndef DECROSS_PLUGIN_H
+#define DECROSS_PLUGIN_H
+
+#include <cstdlib>
+#include <cstring>
+
+#include "process.h"
+
+
+// The frames of DeCross and Mask, shared by the plugins for VapourSynth
+// API v3, in decross.cpp, and v4, in decross4.cpp, which only parse the
+// arguments and make the API calls. Api is the plugin's class for those:
+//
+//  - Frame, the API's type for frames;
+//  - requestFrame(), getFrame(), freeFrame(), getReadPtr(), getWritePtr(),
+//    getStride() and copyFrame(), as in the API, without the frame context
+//    and the core;
+//  - newFrame(vi, src), a frame of vi with the properties of src;
+//  - newLumaFrame(vi, src), the same with src's luma, and the chroma left
+//    to write;
+//  - getInt() and setIntArray() of the properties of a frame, getInt()
+//    returning 0 if they don't have it.
+
+
+// What the filter outputs: the filtered clip for DeCross, the edge mask or
+// the candidate map for Mask.
+enum DeCrossOutput {
+    DECROSS_OUTPUT_CLIP,
+    DECROSS_OUTPUT_EDGES,
+    DECROSS_OUTPUT_CANDIDATES
+};
+
+
+// A DeCross or Mask, with the API's types for clips and their formats.
+template <typename Node, typename VideoInfo>
+struct DeCrossInstance {
+    Node *clip;
+    Node *scenes; // NULL if the clip's own frame properties are used
+    Node *mask; // NULL if the edge check runs
+    const VideoInfo *vi;
+    VideoInfo viOut; // the clip's, or GRAY8 the size of its chroma for Mask
+
+    int nOutput;
+    DeCrossFilter filter;
+};
+
+
+// A frame waiting for its neighbours, between two calls of getFrame.
+template <typename Frame>
+struct DeCrossFrameData {
+    const Frame *src;
+    const Frame *mask; // NULL without a mask clip
+    DeCrossFrameState *state;
+    int nNeighbours;
+    DeCrossStats stats;
+};
+
+
+template <typename Api>
+static void deCrossSetStats(const Api &api, typename Api::Frame *dst, const DeCrossStats *stats) {
+    api.setIntArray(dst, "DeCrossEdgePixels", &stats->nEdgePixels, 1);
+    api.setIntArray(dst, "DeCrossBlocksSearched", &stats->nBlocksSearched, 1);
+    api.setIntArray(dst, "DeCrossBlocksUnchanged", &stats->nBlocksUnchanged, 1);
+    api.setIntArray(dst, "DeCrossWins", stats->nWins, FRAME_COUNT);
+    api.setIntArray(dst, "DeCrossWinsOdd", stats->nWinsOdd, NUM_CANDIDATES_ODD);
+    api.setIntArray(dst, "DeCrossWinsEven", stats->nWinsEven, NUM_CANDIDATES_EVEN);
+    api.setIntArray(dst, "DeCrossEdgeTime", &stats->nEdgeTime, 1);
+    api.setIntArray(dst, "DeCrossSearchTime", &stats->nSearchTime, 1);
+}
+
+
+// Frames returned without filtering still get the stats, all zero except
+// maybe the time spent looking for edges. Their candidate maps are blank.
+template <typename Api, typename Instance>
+static const typename Api::Frame *deCrossUnfiltered(const Api &api, const Instance *d, const typename Api::Frame *src, const typename Api::Frame *mask, const DeCrossStats *stats) {
+    api.freeFrame(mask);
+
+    if (d->nOutput == DECROSS_OUTPUT_CANDIDATES) {
+        typename Api::Frame *dst = api.newFrame(&d->viOut, src);
+        api.freeFrame(src);
+
+        for (int y = 0; y < d->viOut.height; y++)
+            memset(api.getWritePtr(dst, 0) + y * api.getStride(dst, 0), 0, d->viOut.width);
+
+        return dst;
+    }
+
+    if (!d->filter.bStats)
+        return src;
+
+    typename Api::Frame *dst = api.copyFrame(src);
+    api.freeFrame(src);
+
+    deCrossSetStats(api, dst, stats);
+
+    return dst;
+}
+
+
+// The neighbours on the other side of a scene change are left out.
+template <typename Api, typename Instance>
+static int deCrossFindNeighbours(const Api &api, const Instance *d, int n, const typename Api::Frame *src) {
+    if (!d->filter.bNeighbours)
+        return DECROSS_NEIGHBOURS_NONE;
+
+    const typename Api::Frame *scenes = d->scenes ? api.getFrame(n, d->scenes) : src;
+
+    int nNeighbours = DECROSS_NEIGHBOURS_BOTH;
+
+    if (api.getInt(scenes, "_SceneChangePrev"))
+        nNeighbours &= ~DECROSS_NEIGHBOUR_PREV;
+
+    if (api.getInt(scenes, "_SceneChangeNext"))
+        nNeighbours &= ~DECROSS_NEIGHBOUR_NEXT;
+
+    if (d->scenes)
+        api.freeFrame(scenes);
+
+    return nNeighbours;
+}
+
+
+// The edge mask needs only the current frame.
+template <typename Api, typename Instance>
+static const typename Api::Frame *deCrossEdgeMask(const Api &api, const Instance *d, const typename Api::Frame *src) {
+    typename Api::Frame *dst = api.newFrame(&d->viOut, src);
+
+    deCrossFindEdgeMask(&d->filter, api.getReadPtr(src, 0), api.getStride(src, 0), api.getWritePtr(dst, 0), api.getStride(dst, 0));
+
+    api.freeFrame(src);
+
+    return dst;
+}
+
+
+// Without the neighbours, the first and last frames can be filtered too.
+template <typename Instance>
+static bool deCrossIsEnd(const Instance *d, int n) {
+    return d->filter.bNeighbours && (n == 0 || n >= d->vi->numFrames - 1);
+}
+
+
+// For arInitial. The neighbours are requested once the current frame is
+// known to need them.
+template <typename Api, typename Instance>
+static void deCrossRequestFrames(const Api &api, const Instance *d, int n) {
+    api.requestFrame(n, d->clip);
+
+    if (d->nOutput == DECROSS_OUTPUT_EDGES)
+        return;
+
+    const bool bEnds = deCrossIsEnd(d, n);
+
+    if (d->mask && !bEnds)
+        api.requestFrame(n, d->mask);
+
+    if (d->scenes && d->filter.bNeighbours && !bEnds)
+        api.requestFrame(n, d->scenes);
+}
+
+
+// For arAllFramesReady. Returns NULL after requesting the neighbours, with
+// *frameData set to wait for them.
+template <typename Api, typename Instance>
+static const typename Api::Frame *deCrossMakeFrame(const Api &api, const Instance *d, int n, void **frameData) {
+    typedef typename Api::Frame Frame;
+    typedef DeCrossFrameData<Frame> FrameData;
+
+    FrameData *fd = (FrameData *) *frameData;
+
+    if (!fd) {
+        const Frame *src = api.getFrame(n, d->clip);
+
+        if (d->nOutput == DECROSS_OUTPUT_EDGES)
+            return deCrossEdgeMask(api, d, src);
+
+        DeCrossStats stats;
+        memset(&stats, 0, sizeof(stats));
+
+        if (deCrossIsEnd(d, n))
+            return deCrossUnfiltered(api, d, src, NULL, &stats);
+
+        const Frame *mask = d->mask ? api.getFrame(n, d->mask) : NULL;
+
+        const int nNeighbours = deCrossFindNeighbours(api, d, n, src);
+
+        if (!deCrossCanFilter(&d->filter, nNeighbours))
+            return deCrossUnfiltered(api, d, src, mask, &stats);
+
+        fd = (FrameData *)malloc(sizeof(FrameData));
+        memset(fd, 0, sizeof(FrameData));
+        fd->src = src;
+        fd->mask = mask;
+        fd->nNeighbours = nNeighbours;
+        fd->state = deCrossFindFrameEdges(&d->filter, api.getReadPtr(src, 0), api.getStride(src, 0),
+                                          mask ? api.getReadPtr(mask, 0) : NULL, mask ? api.getStride(mask, 0) : 0, &fd->stats);
+
+        // Frames without edges are returned as they are.
+        if (!fd->state) {
+            const Frame *dst = deCrossUnfiltered(api, d, src, mask, &fd->stats);
+            free(fd);
+            return dst;
+        }
+
+        if (nNeighbours != DECROSS_NEIGHBOURS_NONE) {
+            if (nNeighbours & DECROSS_NEIGHBOUR_PREV)
+                api.requestFrame(n - 1, d->clip);
+            if (nNeighbours & DECROSS_NEIGHBOUR_NEXT)
+                api.requestFrame(n + 1, d->clip);
+
+            *frameData = fd;
+            return NULL;
+        }
+    }
+
+    *frameData = NULL;
+
+    const Frame *src = fd->src;
+
+    // Missing neighbours are never read.
+    const Frame *srcP = fd->nNeighbours & DECROSS_NEIGHBOUR_PREV ? api.getFrame(n - 1, d->clip) : src;
+    const Frame *srcF = fd->nNeighbours & DECROSS_NEIGHBOUR_NEXT ? api.getFrame(n + 1, d->clip) : src;
+
+
+    const Frame *frames[FRAME_COUNT] = { srcP, src, srcF };
+
+    DeCrossPlanes p;
+    memset(&p, 0, sizeof(p));
+
+    for (int fr = 0; fr < FRAME_COUNT; fr++) {
+        p.pSrc[fr] = api.getReadPtr(frames[fr], 0);
+        p.pSrcU[fr] = api.getReadPtr(frames[fr], 1);
+        p.pSrcV[fr] = api.getReadPtr(frames[fr], 2);
+    }
+
+    p.nNeighbours = fd->nNeighbours;
+    p.nSrcPitch = api.getStride(src, 0);
+    p.nSrcPitchU = api.getStride(src, 1);
+
+    Frame *dst;
+
+    if (d->nOutput == DECROSS_OUTPUT_CANDIDATES) {
+        dst = api.newFrame(&d->viOut, src);
+
+        p.pMap = api.getWritePtr(dst, 0);
+        p.nMapPitch = api.getStride(dst, 0);
+    } else {
+        // Only the chroma is written.
+        dst = api.newLumaFrame(d->vi, src);
+
+        p.pDstU = api.getWritePtr(dst, 1);
+        p.pDstV = api.getWritePtr(dst, 2);
+        p.nDstPitchU = api.getStride(dst, 1);
+    }
+
+    deCrossFilterFrame(&d->filter, fd->state, &p);
+
+    if (d->filter.bStats)
+        deCrossSetStats(api, dst, &fd->stats);
+
+    if (srcP != src)
+        api.freeFrame(srcP);
+    if (srcF != src)
+        api.freeFrame(srcF);
+    api.freeFrame(src);
+    api.freeFrame(fd->mask);
+
+    free(fd);
+
+    return dst;
+}
+
+
+// For arError. Frees the frame left waiting for its neighbours, if any.
+template <typename Api, typename Instance>
+static void deCrossAbandonFrame(const Api &api, const Instance *d, void **frameData) {
+    DeCrossFrameData<typename Api::Frame> *fd = (DeCrossFrameData<typename Api::Frame> *) *frameData;
+
+    if (fd) {
+        deCrossFreeFrameState(&d->filter, fd->state);
+        api.freeFrame(fd->src);
+        api.freeFrame(fd->mask);
+        free(fd);
+    }
+
+    *frameData = NULL;
+}
+
+#endif // DECROSS_PLUGIN_H
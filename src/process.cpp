@@ -0,0 +1,1053 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "process.h"
+#include "threadpool.h"
+
+
+// A run of blocks with edges, in chroma pixels.
+typedef struct DeCrossSpan {
+    int nXStart;
+    int nXEnd;
+} DeCrossSpan;
+
+
+// The buffers of one slice. The edge buffer is kept clear between uses.
+typedef struct DeCrossArena {
+    uint8_t *pEdgeBuffer;
+    DeCrossSpan *pSpans;
+    int8_t *pBest;
+    int *pKey[2];
+    int *pStamp[2];
+} DeCrossArena;
+
+
+// Arenas not in use, shared by the frames of one filter instance. There are
+// as many as the most slices ever filtered at once.
+struct DeCrossArenaPool {
+    std::mutex mutex;
+    std::vector<DeCrossArena *> arenas;
+    int nRowSizeU;
+};
+
+
+// Candidates for the rows compared against the luma row above them.
+// The order matters: on equal differences the earlier candidate wins.
+#define CANDIDATE(frame, ref, cur, shift, chroma) { LUMA_ROW(frame, ref), LUMA_ROW(FRAME_CUR, cur), shift, CHROMA_ROW(frame, chroma), (shift) / 2, 0, -1 }
+
+#define CANDIDATES_ODD(frame, sign) \
+    CANDIDATE(frame, -2, -1, sign 6, -1), \
+    CANDIDATE(frame, -2, -1, sign 2, -1), \
+    CANDIDATE(frame, -1, -1, sign 4,  0), \
+    CANDIDATE(frame,  2, -1, sign 6,  1), \
+    CANDIDATE(frame,  2, -1, sign 2,  1)
+
+#define CANDIDATES_EVEN(frame, sign) \
+    CANDIDATE(frame, -1,  0, sign 6, -1), \
+    CANDIDATE(frame, -1,  0, sign 2, -1), \
+    CANDIDATE(frame,  0,  0, sign 4,  0), \
+    CANDIDATE(frame,  1,  0, sign 6,  1), \
+    CANDIDATE(frame,  1,  0, sign 2,  1)
+
+static const DeCrossCandidate candidatesOdd[] = {
+    CANDIDATES_ODD(FRAME_PREV, -),
+    CANDIDATES_ODD(FRAME_CUR, -),
+    CANDIDATES_ODD(FRAME_NEXT, -),
+
+    CANDIDATE(FRAME_PREV, -1, -1, 0, 0),
+    CANDIDATE(FRAME_NEXT, -1, -1, 0, 0),
+    CANDIDATE(FRAME_PREV,  1,  1, 0, 0),
+    CANDIDATE(FRAME_NEXT,  1,  1, 0, 0),
+
+    CANDIDATES_ODD(FRAME_PREV, +),
+    CANDIDATES_ODD(FRAME_CUR, +),
+    CANDIDATES_ODD(FRAME_NEXT, +),
+};
+
+// Candidates for the rows compared against their own luma row.
+static const DeCrossCandidate candidatesEven[] = {
+    CANDIDATES_EVEN(FRAME_PREV, -),
+    CANDIDATES_EVEN(FRAME_CUR, -),
+    CANDIDATES_EVEN(FRAME_NEXT, -),
+
+    CANDIDATE(FRAME_PREV, 0, 0, 0, 0),
+    CANDIDATE(FRAME_NEXT, 0, 0, 0, 0),
+
+    CANDIDATES_EVEN(FRAME_PREV, +),
+    CANDIDATES_EVEN(FRAME_CUR, +),
+    CANDIDATES_EVEN(FRAME_NEXT, +),
+};
+
+#undef CANDIDATES_EVEN
+#undef CANDIDATES_ODD
+#undef CANDIDATE
+
+static_assert(sizeof(candidatesOdd) / sizeof(candidatesOdd[0]) == NUM_CANDIDATES_ODD, "NUM_CANDIDATES_ODD is wrong");
+static_assert(sizeof(candidatesEven) / sizeof(candidatesEven[0]) == NUM_CANDIDATES_EVEN, "NUM_CANDIDATES_EVEN is wrong");
+
+
+// Copies the n candidates of pFrom, whose offsets are those of 4:2:2 and
+// 4:2:0, to pTo with offsets for subSamplingW. 4:4:4 keeps the luma offsets
+// and moves the chroma as far. 4:1:1 keeps the chroma offsets, the smallest
+// whole chroma pixels, and moves the luma 4 times as far.
+static void deCrossScaleCandidates(DeCrossCandidate *pTo, const DeCrossCandidate *pFrom, int n, int subSamplingW) {
+    for (int i = 0; i < n; i++) {
+        const int nChromaShift = subSamplingW ? pFrom[i].nChromaShift : pFrom[i].nShift;
+
+        pTo[i] = pFrom[i];
+        pTo[i].nChromaShift = nChromaShift;
+        pTo[i].nShift = nChromaShift * (1 << subSamplingW);
+    }
+}
+
+
+// Points the candidates of pFrom at the candidates of pTo, the next row's,
+// that compare the same luma at the same offset, and marks the latter in
+// pCovered. nLumaStep is the distance between the luma rows of consecutive
+// chroma rows. Returns the number of links.
+static int deCrossLinkCandidates(DeCrossCandidate *pFrom, int nFrom, const DeCrossCandidate *pTo, int nTo, bool *pCovered, int nLumaStep) {
+    int nLinks = 0;
+
+    for (int i = 0; i < nFrom; i++) {
+        for (int j = 0; j < nTo; j++) {
+            const DeCrossCandidate &a = pFrom[i];
+            const DeCrossCandidate &b = pTo[j];
+
+            if (a.nLumaRef / LUMA_ROWS == b.nLumaRef / LUMA_ROWS &&
+                a.nLumaRef % LUMA_ROWS - nLumaStep == b.nLumaRef % LUMA_ROWS &&
+                a.nLumaCur % LUMA_ROWS - nLumaStep == b.nLumaCur % LUMA_ROWS &&
+                a.nShift == b.nShift) {
+                pFrom[i].nNext = b.nIndex;
+                pCovered[j] = true;
+                nLinks++;
+            }
+        }
+    }
+
+    return nLinks;
+}
+
+
+// A candidate still passed on to the next row is searched even when the
+// previous row's key covers it.
+static void deCrossOrderCandidates(DeCrossSearchOrder *pOrder, const DeCrossCandidate *pCandidates, int nCandidates, const bool *pCovered) {
+    int n = 0;
+
+    for (int i = 0; i < nCandidates; i++)
+        if (pCandidates[i].nNext >= 0)
+            pOrder->candidates[n++] = pCandidates[i];
+
+    pOrder->nForwarded = n;
+
+    for (int i = 0; i < nCandidates; i++)
+        if (pCandidates[i].nNext < 0 && !pCovered[i])
+            pOrder->candidates[n++] = pCandidates[i];
+
+    pOrder->nUncovered = n;
+
+    for (int i = 0; i < nCandidates; i++)
+        if (pCandidates[i].nNext < 0 && pCovered[i])
+            pOrder->candidates[n++] = pCandidates[i];
+
+    pOrder->nCandidates = n;
+}
+
+
+// Copies the candidates the search mode uses with the given neighbours
+// into pTo, with their nIndex set, and returns how many there are.
+static int deCrossSelectCandidates(DeCrossCandidate *pTo, const DeCrossCandidate *pFrom, int nFrom, int nSearch, int nNeighbours) {
+    int n = 0;
+
+    for (int i = 0; i < nFrom; i++) {
+        int nFrame = pFrom[i].nChroma / CHROMA_ROWS;
+        bool bSpatial = nFrame == FRAME_CUR;
+
+        if ((nSearch == DECROSS_SEARCH_SPATIAL && !bSpatial) ||
+            (nSearch == DECROSS_SEARCH_TEMPORAL && bSpatial) ||
+            (nFrame == FRAME_PREV && !(nNeighbours & DECROSS_NEIGHBOUR_PREV)) ||
+            (nFrame == FRAME_NEXT && !(nNeighbours & DECROSS_NEIGHBOUR_NEXT)))
+            continue;
+
+        pTo[n] = pFrom[i];
+        pTo[n].nIndex = i;
+        n++;
+    }
+
+    return n;
+}
+
+
+// The fast search stops at the first group of FAST_STOP_STEP candidates
+// that gives a sum of differences below FAST_STOP_DIFF, over 8 luma pixels
+// of 8 bits.
+#define FAST_STOP_DIFF 8
+#define FAST_STOP_STEP 4
+
+
+// Scales a sum of differences over the 8 luma pixels of a 4:2:2 block at 8
+// bits to the block of the filter's format. In 4:4:4 it's rounded up, so
+// that a sum is below it exactly when twice the sum is below nDiff.
+static int deCrossScaleDiff(const DeCrossFilter *d, int nDiff) {
+    return (((nDiff << (d->nBitsPerSample - 8)) << d->subSamplingW) + 1) >> 1;
+}
+
+
+// The chroma pixels left out at each end of a row. The edge check reads a
+// pixel past each side of a block, and the candidates reach 3 chroma pixels
+// past it, 6 in 4:4:4.
+static int deCrossRowBorder(const DeCrossFilter *d) {
+    return d->subSamplingW ? 4 : 8;
+}
+
+
+// The order of the fast search. Rainbows have the opposite phase in the
+// previous and next frames, so where nothing moves the same place in those
+// frames wins most often. The current frame comes next.
+static int deCrossVisitRank(const DeCrossCandidate &c) {
+    if (c.nChroma / CHROMA_ROWS == FRAME_CUR)
+        return 1;
+
+    return c.nShift == 0 ? 0 : 2;
+}
+
+
+static bool deCrossVisitFirst(const DeCrossCandidate &a, const DeCrossCandidate &b) {
+    return deCrossVisitRank(a) < deCrossVisitRank(b);
+}
+
+
+// Stores in pSpans the runs of blocks of 4 chroma pixels with edge flags
+// from nXStart up to nXEnd, joining runs less than nGap pixels apart, and
+// returns how many there are.
+static int deCrossFindSpans(const uint8_t *pEdgeBuffer, int nXStart, int nXEnd, int nGap, DeCrossSpan *pSpans) {
+    int nSpans = 0;
+
+    for (int nX = nXStart; nX < nXEnd; nX += 4) {
+        if (*(const int *)&pEdgeBuffer[nX] == 0)
+            continue;
+
+        if (nSpans > 0 && nX - pSpans[nSpans - 1].nXEnd < nGap) {
+            pSpans[nSpans - 1].nXEnd = nX + 4;
+        } else {
+            pSpans[nSpans].nXStart = nX;
+            pSpans[nSpans].nXEnd = nX + 4;
+            nSpans++;
+        }
+    }
+
+    return nSpans;
+}
+
+
+// The SIMD edge checks write a few bytes past the last block.
+#define EDGE_BUFFER_PADDING 32
+
+
+// All of an arena's buffers are in one allocation, sized for rows of
+// nRowSizeU chroma pixels.
+static DeCrossArena *deCrossNewArena(int nRowSizeU) {
+    // The wider kernels touch a few blocks past the last one.
+    const int nBlocks = nRowSizeU / 4 + 8;
+
+    const size_t nKeysSize = nBlocks * sizeof(int);
+    const size_t nSpansSize = (nRowSizeU / 8 + 1) * sizeof(DeCrossSpan);
+    const size_t nEdgeBufferSize = nRowSizeU + EDGE_BUFFER_PADDING;
+
+    DeCrossArena *arena = (DeCrossArena *)malloc(sizeof(DeCrossArena) + 4 * nKeysSize + nSpansSize + nEdgeBufferSize + nBlocks);
+
+    uint8_t *p = (uint8_t *)(arena + 1);
+
+    for (int i = 0; i < 2; i++) {
+        arena->pKey[i] = (int *)p;
+        p += nKeysSize;
+        arena->pStamp[i] = (int *)p;
+        p += nKeysSize;
+    }
+
+    arena->pSpans = (DeCrossSpan *)p;
+    p += nSpansSize;
+    arena->pEdgeBuffer = p;
+    p += nEdgeBufferSize;
+    arena->pBest = (int8_t *)p;
+
+    memset(arena->pEdgeBuffer, 0, nEdgeBufferSize);
+
+    return arena;
+}
+
+
+static DeCrossArena *deCrossAcquireArena(DeCrossArenaPool *pool) {
+    {
+        std::lock_guard<std::mutex> guard(pool->mutex);
+
+        if (!pool->arenas.empty()) {
+            DeCrossArena *arena = pool->arenas.back();
+            pool->arenas.pop_back();
+            return arena;
+        }
+    }
+
+    return deCrossNewArena(pool->nRowSizeU);
+}
+
+
+static void deCrossReleaseArena(DeCrossArenaPool *pool, DeCrossArena *arena) {
+    std::lock_guard<std::mutex> guard(pool->mutex);
+
+    pool->arenas.push_back(arena);
+}
+
+
+// The frames being filtered. The pointers are at row 0, which is chroma
+// row 1 and luma row 2. Row r uses luma row 2 + (r << subSamplingH).
+// pMask, pMap, pDstU and pDstV may be NULL, as in DeCrossPlanes.
+typedef struct DeCrossFrame {
+    const uint8_t *pSrc[FRAME_COUNT];
+    const uint8_t *pSrcU[FRAME_COUNT];
+    const uint8_t *pSrcV[FRAME_COUNT];
+    uint8_t *pDstU;
+    uint8_t *pDstV;
+    const uint8_t *pMask;
+    uint8_t *pMap;
+    int nSrcPitch;
+    int nSrcPitchU;
+    int nDstPitchU;
+    int nMaskPitch;
+    int nMapPitch;
+    int nRowSizeU;
+    int nHeightU;
+    int nNeighbours;
+} DeCrossFrame;
+
+
+// The rows from nRow up to nRowEnd, filtered by one thread, and its
+// buffers. nSpans and the arena's spans describe row nRow once
+// deCrossFindEdges() has stopped there. Only the blocks from nXStart up to
+// nXEnd are filtered, which is the whole row unless the crop leaves some
+// out. The thread also copies the chroma rows from nCopyStart up to
+// nCopyEnd.
+typedef struct DeCrossSlice {
+    int nRow;
+    int nRowEnd;
+    int nXStart;
+    int nXEnd;
+    int nCopyStart;
+    int nCopyEnd;
+    bool bEdges;
+    DeCrossArena *arena;
+    int nSpans;
+    DeCrossSharedKeys sharedKeys;
+    DeCrossSharedKeys *pShared;
+    DeCrossStats stats;
+} DeCrossSlice;
+
+// Slices shorter than this aren't worth a thread.
+#define MIN_SLICE_ROWS 16
+
+
+static int64_t deCrossNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// The blocks the edge check runs on: the slice's columns and, in case
+// their flags reach into them, one more on each side.
+static void deCrossEdgeColumns(const DeCrossFrame *f, const DeCrossSlice *s, int *pXStart, int *pXEnd) {
+    *pXStart = std::max(s->nXStart - MAX_MARGIN, 4);
+    *pXEnd = std::min(s->nXEnd + MAX_MARGIN, f->nRowSizeU - 4);
+}
+
+
+// The functions taking subSamplingH and bDebug as template parameters have
+// an instance for each combination, picked once per slice, so that the per
+// row work has no branches on them.
+
+// Runs the edge check from row nRow on and stops at the first row with
+// edges. The edge buffer must be clear. Returns false if no row has edges.
+template <int subSamplingH>
+static bool deCrossFindEdges(const DeCrossFilter *d, const DeCrossFrame *f, DeCrossSlice *s) {
+    const DeCrossKernels &k = d->kernels;
+    const int nBytes = d->nBitsPerSample > 8 ? 2 : 1;
+
+    int nXStart, nXEnd;
+    deCrossEdgeColumns(f, s, &nXStart, &nXEnd);
+
+    int64_t nStart = d->bStats ? deCrossNow() : 0;
+
+    for ( ; s->nRow < s->nRowEnd; s->nRow++) {
+        if (f->pMask) {
+            // The mask has the flags the margin spreads past the columns
+            // too, where the edge check would have written them.
+            memcpy(s->arena->pEdgeBuffer + nXStart - MAX_MARGIN, f->pMask + s->nRow * f->nMaskPitch + nXStart - MAX_MARGIN, nXEnd - nXStart + 2 * MAX_MARGIN);
+        } else {
+            const uint8_t *pSrcCur = f->pSrc[FRAME_CUR] + s->nRow * (f->nSrcPitch << subSamplingH);
+
+            // The edge check starts at pixel 4 and stops 4 pixels before
+            // the end of the row, so it is given a row that ends 4 pixels
+            // after nXEnd, starting 4 pixels before nXStart.
+            k.edgeCheck(pSrcCur + ((nXStart - 4) << d->subSamplingW) * nBytes, s->arena->pEdgeBuffer + nXStart - 4, nXEnd - nXStart + 8,
+                        d->nYThreshold << (d->nBitsPerSample - 8), d->nMargin);
+        }
+
+        s->nSpans = deCrossFindSpans(s->arena->pEdgeBuffer, s->nXStart, s->nXEnd, k.nSearchWidth, s->arena->pSpans);
+        if (s->nSpans > 0)
+            break;
+    }
+
+    if (d->bStats)
+        s->stats.nEdgeTime += deCrossNow() - nStart;
+
+    return s->nRow < s->nRowEnd;
+}
+
+
+template <int subSamplingH, bool bDebug>
+static void deCrossFilterRow(const DeCrossFilter *d, const DeCrossFrame *f, DeCrossSlice *s) {
+    const DeCrossKernels &k = d->kernels;
+
+    const int r = s->nRow;
+    const int nRowSizeU = f->nRowSizeU;
+    const int nBytes = d->nBitsPerSample > 8 ? 2 : 1;
+
+    const uint8_t* pEdgeBuffer = s->arena->pEdgeBuffer;
+    const DeCrossSpan* pSpans = s->arena->pSpans;
+    const int8_t* pBest = s->arena->pBest;
+    const int nSpans = s->nSpans;
+
+    uint8_t* pDestU = f->pDstU ? f->pDstU + r * f->nDstPitchU : NULL;
+    uint8_t* pDestV = f->pDstV ? f->pDstV + r * f->nDstPitchU : NULL;
+
+    if (d->bStats) {
+        for (int i = 0; i < nSpans; i++)
+            for (int nX = pSpans[i].nXStart; nX < std::min(pSpans[i].nXEnd, nRowSizeU - 4); nX++)
+                s->stats.nEdgePixels += pEdgeBuffer[nX] != 0;
+    }
+
+    if (bDebug) {
+        for (int i = 0; i < nSpans; i++) {
+            for (int nX = pSpans[i].nXStart; nX < std::min(pSpans[i].nXEnd, nRowSizeU - 4); nX++) {
+                if (pEdgeBuffer[nX] == 0)
+                    continue;
+
+                if (d->nBitsPerSample > 8) {
+                    ((uint16_t *)pDestU)[nX] = 128 << (d->nBitsPerSample - 8);
+                    ((uint16_t *)pDestV)[nX] = 255 << (d->nBitsPerSample - 8);
+                } else {
+                    pDestU[nX] = 128;
+                    pDestV[nX] = 255;
+                }
+            }
+        }
+
+        return;
+    }
+
+    const uint8_t* pLumaRows[FRAME_COUNT * LUMA_ROWS];
+    const uint8_t* pChromaRowsU[FRAME_COUNT * CHROMA_ROWS];
+    const uint8_t* pChromaRowsV[FRAME_COUNT * CHROMA_ROWS];
+
+    for (int fr = 0; fr < FRAME_COUNT; fr++) {
+        const uint8_t* pLuma = f->pSrc[fr] + r * (f->nSrcPitch << subSamplingH);
+
+        for (int rr = -2; rr <= 2; rr++)
+            pLumaRows[LUMA_ROW(fr, rr)] = pLuma + rr * f->nSrcPitch;
+
+        for (int rr = -1; rr <= 1; rr++) {
+            pChromaRowsU[CHROMA_ROW(fr, rr)] = f->pSrcU[fr] + (r + rr) * f->nSrcPitchU;
+            pChromaRowsV[CHROMA_ROW(fr, rr)] = f->pSrcV[fr] + (r + rr) * f->nSrcPitchU;
+        }
+    }
+
+    const DeCrossCandidate *pCandidates = d->candidatesEven;
+    const DeCrossSearchOrder *pOrder = &d->searchEven[f->nNeighbours];
+
+    if ((f->nHeightU - (1 << subSamplingH) - r) % 2 == 1) {
+        pCandidates = d->candidatesOdd;
+        pOrder = &d->searchOdd[f->nNeighbours];
+    }
+
+    s->sharedKeys.nRow = r;
+
+    for (int i = 0; i < nSpans; i++) {
+        k.search(pLumaRows, pOrder, pSpans[i].nXStart, pSpans[i].nXEnd, nRowSizeU, deCrossScaleDiff(d, d->nNoiseThreshold), s->pShared, s->arena->pBest);
+
+        if (d->bStats)
+            s->stats.nBlocksSearched += (pSpans[i].nXEnd - pSpans[i].nXStart) / 4;
+    }
+
+    uint8_t* pMap = f->pMap ? f->pMap + r * f->nMapPitch : NULL;
+
+    for (int i = 0; i < nSpans; i++) {
+        for (int nX = pSpans[i].nXStart; nX < pSpans[i].nXEnd; nX += 4) {
+            if (pMap && *(const int *)&pEdgeBuffer[nX] != 0)
+                memset(pMap + nX, pBest[nX / 4] >= 0 ? pBest[nX / 4] + 1 : DECROSS_MAP_UNCHANGED, 4);
+
+            // Otherwise the chroma is averaged with itself.
+            if (*(const int *)&pEdgeBuffer[nX] != 0 && pBest[nX / 4] >= 0) {
+                const DeCrossCandidate &c = pCandidates[pBest[nX / 4]];
+
+                if (pDestU)
+                    k.averageChroma(pChromaRowsU[CHROMA_ROW(FRAME_CUR, 0)], pChromaRowsV[CHROMA_ROW(FRAME_CUR, 0)],
+                                    pChromaRowsU[c.nChroma] + c.nChromaShift * nBytes, pChromaRowsV[c.nChroma] + c.nChromaShift * nBytes,
+                                    pDestU, pDestV, pEdgeBuffer, nX);
+
+                if (d->bStats) {
+                    s->stats.nWins[c.nChroma / CHROMA_ROWS]++;
+                    (pCandidates == d->candidatesOdd ? s->stats.nWinsOdd : s->stats.nWinsEven)[pBest[nX / 4]]++;
+                }
+            } else if (d->bStats && *(const int *)&pEdgeBuffer[nX] != 0) {
+                s->stats.nBlocksUnchanged++;
+            }
+        }
+    }
+}
+
+
+// Filters the rows of the slice's columns, starting with the one
+// deCrossFindEdges() stopped at. The edge check and the search share the
+// luma while it is in the cache.
+template <int subSamplingH, bool bDebug>
+static void deCrossFilterSlice(const DeCrossFilter *d, const DeCrossFrame *f, DeCrossSlice *s) {
+    s->pShared = NULL;
+
+    if (d->bShareKeys) {
+        const int nBlocks = f->nRowSizeU / 4 + 8;
+
+        for (int i = 0; i < 2; i++) {
+            s->sharedKeys.pKey[i] = s->arena->pKey[i];
+            s->sharedKeys.pStamp[i] = s->arena->pStamp[i];
+
+            for (int j = 0; j < nBlocks; j++)
+                s->sharedKeys.pStamp[i][j] = -2;
+        }
+
+        s->pShared = &s->sharedKeys;
+    }
+
+    int nXStart, nXEnd;
+    deCrossEdgeColumns(f, s, &nXStart, &nXEnd);
+
+    do {
+        int64_t nStart = d->bStats ? deCrossNow() : 0;
+
+        deCrossFilterRow<subSamplingH, bDebug>(d, f, s);
+
+        if (d->bStats)
+            s->stats.nSearchTime += deCrossNow() - nStart;
+
+        // The buffer is cleared only after rows with edges, and only where
+        // the edge check wrote.
+        memset(s->arena->pEdgeBuffer + nXStart - MAX_MARGIN, 0, nXEnd - nXStart + MAX_MARGIN + EDGE_BUFFER_PADDING);
+        s->nRow++;
+    } while (deCrossFindEdges<subSamplingH>(d, f, s));
+}
+
+
+typedef struct DeCrossSliceJob {
+    const DeCrossFilter *d;
+    const DeCrossFrame *f;
+    DeCrossSlice *pSlices;
+} DeCrossSliceJob;
+
+
+static void deCrossFindEdgesTask(void *pData, int nSlice) {
+    DeCrossSliceJob *job = (DeCrossSliceJob *)pData;
+    DeCrossSlice *s = &job->pSlices[nSlice];
+
+    if (job->d->subSamplingH)
+        s->bEdges = deCrossFindEdges<1>(job->d, job->f, s);
+    else
+        s->bEdges = deCrossFindEdges<0>(job->d, job->f, s);
+}
+
+
+static void deCrossCopyRows(uint8_t *pDst, int nDstPitch, const uint8_t *pSrc, int nSrcPitch, int nRowSize, int nRows) {
+    for (int y = 0; y < nRows; y++)
+        memcpy(pDst + y * nDstPitch, pSrc + y * nSrcPitch, nRowSize);
+}
+
+
+static void deCrossClearRows(uint8_t *pDst, int nDstPitch, int nRowSize, int nRows) {
+    for (int y = 0; y < nRows; y++)
+        memset(pDst + y * nDstPitch, 0, nRowSize);
+}
+
+
+// The luma of the output frame is the source's, but the chroma is new.
+static void deCrossFilterSliceTask(void *pData, int nSlice) {
+    DeCrossSliceJob *job = (DeCrossSliceJob *)pData;
+    DeCrossSlice *s = &job->pSlices[nSlice];
+    const DeCrossFrame *f = job->f;
+    const int nBytes = job->d->nBitsPerSample > 8 ? 2 : 1;
+
+    // The pointers are at chroma row 1.
+    if (f->pDstU) {
+        deCrossCopyRows(f->pDstU + (s->nCopyStart - 1) * f->nDstPitchU, f->nDstPitchU,
+                        f->pSrcU[FRAME_CUR] + (s->nCopyStart - 1) * f->nSrcPitchU, f->nSrcPitchU,
+                        f->nRowSizeU * nBytes, s->nCopyEnd - s->nCopyStart);
+        deCrossCopyRows(f->pDstV + (s->nCopyStart - 1) * f->nDstPitchU, f->nDstPitchU,
+                        f->pSrcV[FRAME_CUR] + (s->nCopyStart - 1) * f->nSrcPitchU, f->nSrcPitchU,
+                        f->nRowSizeU * nBytes, s->nCopyEnd - s->nCopyStart);
+    }
+
+    if (f->pMap)
+        deCrossClearRows(f->pMap + (s->nCopyStart - 1) * f->nMapPitch, f->nMapPitch, f->nRowSizeU, s->nCopyEnd - s->nCopyStart);
+
+    if (!s->bEdges)
+        return;
+
+    const DeCrossFilter *d = job->d;
+
+    if (d->subSamplingH && d->bDebug)
+        deCrossFilterSlice<1, true>(d, f, s);
+    else if (d->subSamplingH)
+        deCrossFilterSlice<1, false>(d, f, s);
+    else if (d->bDebug)
+        deCrossFilterSlice<0, true>(d, f, s);
+    else
+        deCrossFilterSlice<0, false>(d, f, s);
+}
+
+
+static void deCrossRunSlices(const DeCrossFilter *d, DeCrossTaskFunction task, DeCrossSliceJob *job, int nSlices) {
+    if (d->pool) {
+        d->pool->run(task, job, nSlices);
+    } else {
+        for (int i = 0; i < nSlices; i++)
+            task(job, i);
+    }
+}
+
+
+// Adds the slices' stats to pStats, if not NULL, and frees them.
+static void deCrossFreeSlices(const DeCrossFilter *d, DeCrossSlice *pSlices, int nSlices, DeCrossStats *pStats) {
+    for (int i = 0; i < nSlices; i++) {
+        deCrossReleaseArena(d->arenas, pSlices[i].arena);
+
+        if (!pStats)
+            continue;
+
+        const DeCrossStats &stats = pSlices[i].stats;
+
+        pStats->nEdgePixels += stats.nEdgePixels;
+        pStats->nBlocksSearched += stats.nBlocksSearched;
+        pStats->nBlocksUnchanged += stats.nBlocksUnchanged;
+        pStats->nEdgeTime += stats.nEdgeTime;
+        pStats->nSearchTime += stats.nSearchTime;
+
+        for (int fr = 0; fr < FRAME_COUNT; fr++)
+            pStats->nWins[fr] += stats.nWins[fr];
+
+        for (int c = 0; c < MAX_CANDIDATES; c++) {
+            pStats->nWinsOdd[c] += stats.nWinsOdd[c];
+            pStats->nWinsEven[c] += stats.nWinsEven[c];
+        }
+    }
+
+    free(pSlices);
+}
+
+
+// A luma pixel belongs to a black border if it is at most this, at 8 bits.
+#define BLACK_LEVEL 32
+
+
+// Whether the nCount luma pixels from pSrc on, nStep bytes apart, are all
+// black.
+template <typename PixelType>
+static bool deCrossIsBlack(const uint8_t *pSrc, int nStep, int nCount, int nLevel) {
+    for (int i = 0; i < nCount; i++)
+        if (*(const PixelType *)(pSrc + i * nStep) > nLevel)
+            return false;
+
+    return true;
+}
+
+
+// Widens the crop by the black rows and then the black columns next to it.
+template <typename PixelType>
+static void deCrossFindBlackBorders(const DeCrossFilter *d, const uint8_t *pSrc, int nSrcPitch, int *pLeft, int *pTop, int *pRight, int *pBottom) {
+    const int nBytes = sizeof(PixelType);
+    const int nLevel = BLACK_LEVEL << (d->nBitsPerSample - 8);
+    int &nLeft = *pLeft, &nTop = *pTop, &nRight = *pRight, &nBottom = *pBottom;
+
+    const int nColumns = std::max(d->nWidth - nLeft - nRight, 0);
+
+    while (nTop + nBottom < d->nHeight && deCrossIsBlack<PixelType>(pSrc + nTop * nSrcPitch + nLeft * nBytes, nBytes, nColumns, nLevel))
+        nTop++;
+
+    while (nTop + nBottom < d->nHeight && deCrossIsBlack<PixelType>(pSrc + (d->nHeight - 1 - nBottom) * nSrcPitch + nLeft * nBytes, nBytes, nColumns, nLevel))
+        nBottom++;
+
+    const int nRows = d->nHeight - nTop - nBottom;
+    const uint8_t *pRows = pSrc + nTop * nSrcPitch;
+
+    while (nLeft + nRight < d->nWidth && deCrossIsBlack<PixelType>(pRows + nLeft * nBytes, nSrcPitch, nRows, nLevel))
+        nLeft++;
+
+    while (nLeft + nRight < d->nWidth && deCrossIsBlack<PixelType>(pRows + (d->nWidth - 1 - nRight) * nBytes, nSrcPitch, nRows, nLevel))
+        nRight++;
+}
+
+
+// The rows and the blocks of a frame that can be filtered. Only chroma
+// pixels that are entirely inside the crop are, so the blocks start and
+// end on multiples of 4 inside it, except at the end of the row where
+// there is no crop. Inside the crop the output is the same as without it,
+// since the edge check and the search still read the luma around it.
+typedef struct DeCrossRegion {
+    int nRow;
+    int nRowEnd;
+    int nXStart;
+    int nXEnd;
+} DeCrossRegion;
+
+
+int deCrossRowEnd(const DeCrossFilter *d) {
+    const int nHeightU = d->nHeight >> d->subSamplingH;
+
+    // Row r reads the luma from row (r << subSamplingH) + 2 down to two
+    // rows below it, so the last one that stays inside the frame is row
+    // (nHeight - 5) >> subSamplingH. Only without vertical subsampling is
+    // that bound below the other one.
+    return std::min(nHeightU - 2 * (1 << d->subSamplingH), (d->nHeight - 4) >> d->subSamplingH);
+}
+
+
+static void deCrossFindRegion(const DeCrossFilter *d, const uint8_t *pSrc, int nSrcPitch, DeCrossRegion *pRegion) {
+    int nLeft = d->nLeft;
+    int nTop = d->nTop;
+    int nRight = d->nRight;
+    int nBottom = d->nBottom;
+
+    if (d->bAutoCrop && d->nBitsPerSample > 8)
+        deCrossFindBlackBorders<uint16_t>(d, pSrc, nSrcPitch, &nLeft, &nTop, &nRight, &nBottom);
+    else if (d->bAutoCrop)
+        deCrossFindBlackBorders<uint8_t>(d, pSrc, nSrcPitch, &nLeft, &nTop, &nRight, &nBottom);
+
+    const int nRowSizeU = d->nWidth >> d->subSamplingW;
+
+    pRegion->nRow = std::max(((nTop + (1 << d->subSamplingH) - 1) >> d->subSamplingH) - 1, 0);
+    pRegion->nRowEnd = std::min(((d->nHeight - nBottom) >> d->subSamplingH) - 1, deCrossRowEnd(d));
+
+    pRegion->nXStart = std::max(((nLeft + (1 << d->subSamplingW) - 1) >> d->subSamplingW) + 3, deCrossRowBorder(d)) / 4 * 4;
+    // The last block and the luma its candidates reach stay inside the row.
+    pRegion->nXEnd = (nRowSizeU - SEARCH_REACH(d->subSamplingW)) & ~3;
+    if (nRight > 0)
+        pRegion->nXEnd = std::min(pRegion->nXEnd, ((d->nWidth - nRight) >> d->subSamplingW) & ~3);
+}
+
+
+struct DeCrossFrameState {
+    DeCrossFrame f;
+    DeCrossSlice *pSlices;
+    int nSlices;
+    DeCrossStats *pStats;
+};
+
+
+DeCrossFrameState *deCrossFindFrameEdges(const DeCrossFilter *d, const uint8_t *pSrc, int nSrcPitch, const uint8_t *pMask, int nMaskPitch, DeCrossStats *pStats) {
+    DeCrossFrameState *state = (DeCrossFrameState *)calloc(1, sizeof(DeCrossFrameState));
+    state->pStats = d->bStats ? pStats : NULL;
+    DeCrossFrame &f = state->f;
+
+    f.nHeightU = d->nHeight >> d->subSamplingH;
+    f.nRowSizeU = d->nWidth >> d->subSamplingW;
+    f.nSrcPitch = nSrcPitch;
+
+    f.pSrc[FRAME_CUR] = pSrc + f.nSrcPitch * 2;
+    f.pMask = pMask ? pMask + nMaskPitch : NULL;
+    f.nMaskPitch = nMaskPitch;
+
+    DeCrossRegion region;
+    deCrossFindRegion(d, pSrc, nSrcPitch, &region);
+
+    const int nRows = region.nRowEnd - region.nRow;
+
+    if (nRows <= 0 || region.nXEnd <= region.nXStart) {
+        free(state);
+        return NULL;
+    }
+
+    const int nSlices = std::max(std::min(d->nThreads, nRows / MIN_SLICE_ROWS), 1);
+
+    state->pSlices = (DeCrossSlice *)calloc(nSlices, sizeof(DeCrossSlice));
+    state->nSlices = nSlices;
+
+    for (int i = 0; i < nSlices; i++) {
+        DeCrossSlice &s = state->pSlices[i];
+
+        s.nRow = region.nRow + nRows * i / nSlices;
+        s.nRowEnd = region.nRow + nRows * (i + 1) / nSlices;
+        s.nCopyStart = i == 0 ? 0 : s.nRow + 1;
+        s.nCopyEnd = i == nSlices - 1 ? f.nHeightU : s.nRowEnd + 1;
+        s.nXStart = region.nXStart;
+        s.nXEnd = region.nXEnd;
+        s.arena = deCrossAcquireArena(d->arenas);
+    }
+
+    DeCrossSliceJob job = { d, &f, state->pSlices };
+
+    // Look for the first row with edges in each slice.
+    deCrossRunSlices(d, deCrossFindEdgesTask, &job, nSlices);
+
+    bool bEdges = false;
+    for (int i = 0; i < nSlices; i++)
+        bEdges = bEdges || state->pSlices[i].bEdges;
+
+    if (!bEdges) {
+        deCrossFreeSlices(d, state->pSlices, nSlices, state->pStats);
+        free(state);
+
+        return NULL;
+    }
+
+    return state;
+}
+
+
+void deCrossFilterFrame(const DeCrossFilter *d, DeCrossFrameState *state, const DeCrossPlanes *planes) {
+    DeCrossFrame &f = state->f;
+
+    f.nSrcPitch = planes->nSrcPitch;
+    f.nSrcPitchU = planes->nSrcPitchU;
+    f.nDstPitchU = planes->nDstPitchU;
+    f.nNeighbours = d->bNeighbours ? planes->nNeighbours : DECROSS_NEIGHBOURS_NONE;
+
+    for (int fr = 0; fr < FRAME_COUNT; fr++) {
+        f.pSrc[fr] = planes->pSrc[fr] + f.nSrcPitch * 2;
+        f.pSrcU[fr] = planes->pSrcU[fr] + f.nSrcPitchU;
+        f.pSrcV[fr] = planes->pSrcV[fr] + f.nSrcPitchU;
+    }
+
+    f.pDstU = planes->pDstU ? planes->pDstU + f.nDstPitchU : NULL;
+    f.pDstV = planes->pDstV ? planes->pDstV + f.nDstPitchU : NULL;
+    f.pMap = planes->pMap ? planes->pMap + planes->nMapPitch : NULL;
+    f.nMapPitch = planes->nMapPitch;
+
+    DeCrossSliceJob job = { d, &f, state->pSlices };
+
+    deCrossRunSlices(d, deCrossFilterSliceTask, &job, state->nSlices);
+
+    deCrossFreeFrameState(d, state);
+}
+
+
+void deCrossFreeFrameState(const DeCrossFilter *d, DeCrossFrameState *state) {
+    deCrossFreeSlices(d, state->pSlices, state->nSlices, state->pStats);
+    free(state);
+}
+
+
+bool deCrossCanFilter(const DeCrossFilter *d, int nNeighbours) {
+    if (!d->bNeighbours)
+        nNeighbours = DECROSS_NEIGHBOURS_NONE;
+
+    return d->searchOdd[nNeighbours].nCandidates > 0 || d->searchEven[nNeighbours].nCandidates > 0;
+}
+
+
+void deCrossProcessFrame(const DeCrossFilter *d, const DeCrossPlanes *planes, DeCrossStats *pStats) {
+    DeCrossFrameState *state = deCrossFindFrameEdges(d, planes->pSrc[FRAME_CUR], planes->nSrcPitch, planes->pMask, planes->nMaskPitch, pStats);
+
+    if (state) {
+        deCrossFilterFrame(d, state, planes);
+        return;
+    }
+
+    const int nRowSizeU = d->nWidth >> d->subSamplingW;
+    const int nRowBytesU = nRowSizeU * (d->nBitsPerSample > 8 ? 2 : 1);
+    const int nHeightU = d->nHeight >> d->subSamplingH;
+
+    if (planes->pDstU) {
+        deCrossCopyRows(planes->pDstU, planes->nDstPitchU, planes->pSrcU[FRAME_CUR], planes->nSrcPitchU, nRowBytesU, nHeightU);
+        deCrossCopyRows(planes->pDstV, planes->nDstPitchU, planes->pSrcV[FRAME_CUR], planes->nSrcPitchU, nRowBytesU, nHeightU);
+    }
+
+    if (planes->pMap)
+        deCrossClearRows(planes->pMap, planes->nMapPitch, nRowSizeU, nHeightU);
+}
+
+
+typedef struct DeCrossMaskJob {
+    const DeCrossFilter *d;
+    const uint8_t *pSrc;
+    uint8_t *pMask;
+    int nSrcPitch;
+    int nMaskPitch;
+    DeCrossRegion region;
+    int nSlices;
+} DeCrossMaskJob;
+
+
+// The pointers are at chroma row 1, as in DeCrossFrame.
+static void deCrossEdgeMaskTask(void *pData, int nSlice) {
+    const DeCrossMaskJob *job = (const DeCrossMaskJob *)pData;
+    const DeCrossFilter *d = job->d;
+    const DeCrossRegion &region = job->region;
+    const int nRowSizeU = d->nWidth >> d->subSamplingW;
+    const int nRows = region.nRowEnd - region.nRow;
+
+    // Where the last block ends.
+    const int nXEnd = std::min((region.nXEnd + 3) & ~3, nRowSizeU);
+
+    DeCrossArena *arena = deCrossAcquireArena(d->arenas);
+
+    for (int r = region.nRow + nRows * nSlice / job->nSlices; r < region.nRow + nRows * (nSlice + 1) / job->nSlices; r++) {
+        d->kernels.edgeCheck(job->pSrc + r * (job->nSrcPitch << d->subSamplingH), arena->pEdgeBuffer, nRowSizeU,
+                             d->nYThreshold << (d->nBitsPerSample - 8), d->nMargin);
+
+        uint8_t *pMask = job->pMask + r * job->nMaskPitch;
+
+        for (int nX = 0; nX < nRowSizeU; nX++)
+            pMask[nX] = arena->pEdgeBuffer[nX] && nX >= region.nXStart && nX < nXEnd ? DECROSS_MASK_EDGE : 0;
+
+        memset(arena->pEdgeBuffer, 0, nRowSizeU + EDGE_BUFFER_PADDING);
+    }
+
+    deCrossReleaseArena(d->arenas, arena);
+}
+
+
+void deCrossFindEdgeMask(const DeCrossFilter *d, const uint8_t *pSrc, int nSrcPitch, uint8_t *pMask, int nMaskPitch) {
+    const int nRowSizeU = d->nWidth >> d->subSamplingW;
+    const int nHeightU = d->nHeight >> d->subSamplingH;
+
+    DeCrossMaskJob job = { d, pSrc + nSrcPitch * 2, pMask + nMaskPitch, nSrcPitch, nMaskPitch, { 0, 0, 0, 0 }, 1 };
+    DeCrossRegion &region = job.region;
+
+    deCrossFindRegion(d, pSrc, nSrcPitch, &region);
+
+    if (region.nRowEnd <= region.nRow || region.nXEnd <= region.nXStart) {
+        deCrossClearRows(pMask, nMaskPitch, nRowSizeU, nHeightU);
+        return;
+    }
+
+    // The rows above and below those the edge check runs on.
+    deCrossClearRows(pMask, nMaskPitch, nRowSizeU, region.nRow + 1);
+    deCrossClearRows(pMask + (region.nRowEnd + 1) * nMaskPitch, nMaskPitch, nRowSizeU, nHeightU - region.nRowEnd - 1);
+
+    job.nSlices = std::max(std::min(d->nThreads, (region.nRowEnd - region.nRow) / MIN_SLICE_ROWS), 1);
+
+    if (d->pool) {
+        d->pool->run(deCrossEdgeMaskTask, &job, job.nSlices);
+    } else {
+        for (int i = 0; i < job.nSlices; i++)
+            deCrossEdgeMaskTask(&job, i);
+    }
+}
+
+
+const char *deCrossCheckParams(DeCrossFilter *d, int opt, const char *search) {
+    if (d->nYThreshold < 0 || d->nYThreshold > 255)
+        return "thresholdy must be between 0 and 255 (inclusive).";
+
+    if (d->nNoiseThreshold < 0 || d->nNoiseThreshold > 255)
+        return "noise must be between 0 and 255 (inclusive).";
+
+    if (d->nMargin < 0 || d->nMargin > MAX_MARGIN)
+        return "margin must be between 0 and 4 (inclusive).";
+
+    if (opt < DECROSS_OPT_C || opt > DECROSS_OPT_AVX512)
+        return "opt must be between 0 and 3 (inclusive).";
+
+    if (d->nThreads < 0 || d->nThreads > 64)
+        return "threads must be between 0 and 64 (inclusive).";
+
+    if (d->nLeft < 0 || d->nTop < 0 || d->nRight < 0 || d->nBottom < 0)
+        return "left, top, right, and bottom must not be negative.";
+
+    if (!strcmp(search, "full"))
+        d->nSearch = DECROSS_SEARCH_FULL;
+    else if (!strcmp(search, "fast"))
+        d->nSearch = DECROSS_SEARCH_FAST;
+    else if (!strcmp(search, "spatial"))
+        d->nSearch = DECROSS_SEARCH_SPATIAL;
+    else if (!strcmp(search, "temporal"))
+        d->nSearch = DECROSS_SEARCH_TEMPORAL;
+    else
+        return "search must be \"full\", \"fast\", \"spatial\", or \"temporal\".";
+
+    return NULL;
+}
+
+
+int deCrossInitFilter(DeCrossFilter *d, int opt) {
+    const int nLevel = deCrossSelectKernels(&d->kernels, opt, d->nBitsPerSample, d->subSamplingW);
+
+    deCrossScaleCandidates(d->candidatesOdd, candidatesOdd, NUM_CANDIDATES_ODD, d->subSamplingW);
+    deCrossScaleCandidates(d->candidatesEven, candidatesEven, NUM_CANDIDATES_EVEN, d->subSamplingW);
+
+    d->bNeighbours = d->nSearch != DECROSS_SEARCH_SPATIAL;
+    d->bShareKeys = false;
+
+    for (int nNeighbours = 0; nNeighbours < DECROSS_NEIGHBOURS_COUNT; nNeighbours++) {
+        DeCrossCandidate odd[MAX_CANDIDATES];
+        DeCrossCandidate even[MAX_CANDIDATES];
+        bool bCoveredOdd[MAX_CANDIDATES] = { false };
+        bool bCoveredEven[MAX_CANDIDATES] = { false };
+
+        int nOdd = deCrossSelectCandidates(odd, d->candidatesOdd, NUM_CANDIDATES_ODD, d->nSearch, nNeighbours);
+        int nEven = deCrossSelectCandidates(even, d->candidatesEven, NUM_CANDIDATES_EVEN, d->nSearch, nNeighbours);
+
+        // Stopping early would leave the keys for the next row incomplete,
+        // so the fast search doesn't share them.
+        if (d->nSearch == DECROSS_SEARCH_FAST) {
+            std::stable_sort(odd, odd + nOdd, deCrossVisitFirst);
+            std::stable_sort(even, even + nEven, deCrossVisitFirst);
+        } else {
+            // Rows alternate between odd and even, in both orders.
+            int nLumaStep = 1 << d->subSamplingH;
+            int nLinks = deCrossLinkCandidates(odd, nOdd, even, nEven, bCoveredEven, nLumaStep) +
+                         deCrossLinkCandidates(even, nEven, odd, nOdd, bCoveredOdd, nLumaStep);
+            d->bShareKeys = d->bShareKeys || nLinks > 0;
+        }
+
+        DeCrossSearchOrder *orders[2] = { &d->searchOdd[nNeighbours], &d->searchEven[nNeighbours] };
+
+        deCrossOrderCandidates(orders[0], odd, nOdd, bCoveredOdd);
+        deCrossOrderCandidates(orders[1], even, nEven, bCoveredEven);
+
+        for (int i = 0; i < 2; i++) {
+            if (d->nSearch == DECROSS_SEARCH_FAST) {
+                orders[i]->nStopKey = SAD_KEY(deCrossScaleDiff(d, FAST_STOP_DIFF), 0);
+                orders[i]->nStopStep = FAST_STOP_STEP;
+            } else {
+                orders[i]->nStopKey = 0;
+                orders[i]->nStopStep = MAX_CANDIDATES;
+            }
+        }
+    }
+
+
+    if (d->nThreads == 0)
+        d->nThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+
+    d->pool = NULL;
+    if (d->nThreads > 1)
+        d->pool = new DeCrossThreadPool(d->nThreads);
+
+    // One arena per slice of a frame. More are made if several frames are
+    // filtered at once.
+    d->arenas = new DeCrossArenaPool;
+    d->arenas->nRowSizeU = d->nWidth >> d->subSamplingW;
+
+    for (int i = 0; i < d->nThreads; i++)
+        d->arenas->arenas.push_back(deCrossNewArena(d->arenas->nRowSizeU));
+
+    return nLevel;
+}
+
+
+void deCrossFreeFilter(DeCrossFilter *d) {
+    delete d->pool;
+
+    for (size_t i = 0; i < d->arenas->arenas.size(); i++)
+        free(d->arenas->arenas[i]);
+    delete d->arenas;
+}
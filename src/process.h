@@ -0,0 +1,173 @@
+#ifndef DECROSS_PROCESS_H
+#define DECROSS_PROCESS_H
+
+#include <cstdint>
+
+#include "kernels.h"
+
+
+class DeCrossThreadPool;
+struct DeCrossArenaPool;
+struct DeCrossFrameState;
+
+
+enum DeCrossSearchMode {
+    DECROSS_SEARCH_FULL,
+    DECROSS_SEARCH_FAST, // visits the likeliest candidates first and stops at a close enough match
+    DECROSS_SEARCH_SPATIAL, // only the current frame
+    DECROSS_SEARCH_TEMPORAL // only the previous and next frames
+};
+
+
+// Which of the previous and next frames a frame can be filtered with. They
+// are left out at scene changes.
+enum DeCrossNeighbours {
+    DECROSS_NEIGHBOURS_NONE,
+    DECROSS_NEIGHBOUR_PREV,
+    DECROSS_NEIGHBOUR_NEXT,
+    DECROSS_NEIGHBOURS_BOTH,
+    DECROSS_NEIGHBOURS_COUNT
+};
+
+
+// Everything needed to filter the frames of one clip, without VapourSynth.
+// The caller sets the parameters and the dimensions, then calls
+// deCrossInitFilter().
+typedef struct DeCrossFilter {
+    int nYThreshold;
+    int nNoiseThreshold;
+    int nMargin;
+    bool bDebug;
+
+    int nWidth;
+    int nHeight;
+    int subSamplingW;
+    int subSamplingH;
+    int nBitsPerSample; // 8 to 16, the thresholds are scaled to match
+
+    int nThreads; // 0 means one per CPU core
+    bool bStats;
+    int nSearch;
+
+    // Luma pixels left out on each side of the frame, whose chroma is
+    // copied. With bAutoCrop the black borders found inside them in each
+    // frame are left out too.
+    int nLeft;
+    int nTop;
+    int nRight;
+    int nBottom;
+    bool bAutoCrop;
+
+    DeCrossKernels kernels;
+
+    // The candidates with their offsets scaled to subSamplingW.
+    DeCrossCandidate candidatesOdd[MAX_CANDIDATES];
+    DeCrossCandidate candidatesEven[MAX_CANDIDATES];
+
+    // Indexed by the DeCrossNeighbours of the frame.
+    DeCrossSearchOrder searchOdd[DECROSS_NEIGHBOURS_COUNT];
+    DeCrossSearchOrder searchEven[DECROSS_NEIGHBOURS_COUNT];
+    bool bShareKeys;
+    bool bNeighbours; // whether the previous and next frames are used at all
+
+    DeCrossThreadPool *pool;
+    DeCrossArenaPool *arenas;
+} DeCrossFilter;
+
+
+// The number of candidates of the rows compared against the luma row above
+// them and of those compared against their own.
+#define NUM_CANDIDATES_ODD 34
+#define NUM_CANDIDATES_EVEN 32
+
+
+// What happened to a frame, for stats=True. The times are in nanoseconds,
+// summed over the threads.
+typedef struct DeCrossStats {
+    int64_t nEdgePixels; // chroma pixels flagged by the edge check
+    int64_t nBlocksSearched;
+    int64_t nBlocksUnchanged; // blocks with edges where no candidate beat nNoiseThreshold
+    int64_t nWins[FRAME_COUNT]; // blocks filtered with the chroma of each frame
+    int64_t nWinsOdd[MAX_CANDIDATES]; // by nIndex, in the rows compared against the luma row above
+    int64_t nWinsEven[MAX_CANDIDATES]; // by nIndex, in the rows compared against their own luma row
+    int64_t nEdgeTime;
+    int64_t nSearchTime;
+} DeCrossStats;
+
+
+// The planes of the previous, current and next frames and the chroma planes
+// of the output, from their first row. The previous and next frames are
+// only read if filter->bNeighbours is set and nNeighbours includes them.
+// Otherwise they can be the current one.
+//
+// If pMask is set, it replaces the edge check: a plane the size of the
+// chroma whose pixels that aren't 0 are edges. If pMap is set, it gets the
+// candidate map, a plane the size of the chroma with the chosen candidate
+// of each block, and pDstU and pDstV may be NULL. The map is 0 where there
+// are no edges, 255 where no candidate beat the noise threshold, and the
+// candidate's nIndex + 1 elsewhere.
+typedef struct DeCrossPlanes {
+    int nNeighbours;
+    const uint8_t *pSrc[FRAME_COUNT];
+    const uint8_t *pSrcU[FRAME_COUNT];
+    const uint8_t *pSrcV[FRAME_COUNT];
+    uint8_t *pDstU;
+    uint8_t *pDstV;
+    int nSrcPitch;
+    int nSrcPitchU;
+    int nDstPitchU;
+    const uint8_t *pMask;
+    int nMaskPitch;
+    uint8_t *pMap;
+    int nMapPitch;
+} DeCrossPlanes;
+
+
+// The values of the edge mask and of the candidate map.
+#define DECROSS_MASK_EDGE 255
+#define DECROSS_MAP_UNCHANGED 255
+
+
+// Checks the parameters set by the caller and sets nSearch from search,
+// the name of the search mode. Returns the message to report if one of
+// them is out of range, or NULL.
+const char *deCrossCheckParams(DeCrossFilter *filter, int opt, const char *search);
+
+// Picks the kernels, up to the level opt, and builds the search orders, the
+// threads and the buffers. Returns the level of the kernels.
+int deCrossInitFilter(DeCrossFilter *filter, int opt);
+
+void deCrossFreeFilter(DeCrossFilter *filter);
+
+
+// The first pass, over the luma of the current frame only, or over pMask
+// instead if it isn't NULL, as in DeCrossPlanes. pMask is read by both
+// passes. Returns NULL if the frame has no edges, in which case the output
+// is the source. If filter->bStats is set, both passes add to pStats,
+// which must be cleared first.
+DeCrossFrameState *deCrossFindFrameEdges(const DeCrossFilter *filter, const uint8_t *pSrc, int nSrcPitch, const uint8_t *pMask, int nMaskPitch, DeCrossStats *pStats);
+
+// The second pass. Writes all of the output chroma and frees the state.
+void deCrossFilterFrame(const DeCrossFilter *filter, DeCrossFrameState *state, const DeCrossPlanes *planes);
+
+// Frees the state of a frame that won't get its second pass.
+void deCrossFreeFrameState(const DeCrossFilter *filter, DeCrossFrameState *state);
+
+// The end of the rows the filter can search, row r being chroma row r + 1,
+// set by the luma the search reads two rows above and below them.
+int deCrossRowEnd(const DeCrossFilter *filter);
+
+// Whether any candidate is left with only the given neighbours.
+bool deCrossCanFilter(const DeCrossFilter *filter, int nNeighbours);
+
+// Both passes. The output chroma is a copy of the source's if the frame has
+// no edges. pStats may be NULL if filter->bStats isn't set.
+void deCrossProcessFrame(const DeCrossFilter *filter, const DeCrossPlanes *planes, DeCrossStats *pStats);
+
+// Writes the edge mask of the current frame to pMask, a plane the size of
+// the chroma: DECROSS_MASK_EDGE where the edge check finds edges and 0
+// elsewhere, including the rows and columns that are never filtered or are
+// left out by the crop.
+void deCrossFindEdgeMask(const DeCrossFilter *filter, const uint8_t *pSrc, int nSrcPitch, uint8_t *pMask, int nMaskPitch);
+
+#endif // DECROSS_PROCESS_H
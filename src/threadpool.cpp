@@ -0,0 +1,88 @@
+#include <algorithm>
+
+#include "threadpool.h"
+
+
+DeCrossThreadPool::DeCrossThreadPool(int nThreads) : bQuit(false) {
+    for (int i = 1; i < nThreads; i++)
+        workers.push_back(std::thread(&DeCrossThreadPool::work, this));
+}
+
+
+DeCrossThreadPool::~DeCrossThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        bQuit = true;
+    }
+
+    wake.notify_all();
+
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+
+// Takes the next task of pBatch, or of the oldest queued batch if pBatch is
+// NULL, and runs it with the mutex released. Returns false if there was no
+// task left to take.
+bool DeCrossThreadPool::runOne(std::unique_lock<std::mutex> &lock, Batch *pBatch) {
+    if (!pBatch) {
+        if (queue.empty())
+            return false;
+
+        pBatch = queue.front();
+    }
+
+    if (pBatch->nNext == pBatch->nTasks)
+        return false;
+
+    int nTask = pBatch->nNext++;
+
+    if (pBatch->nNext == pBatch->nTasks) {
+        std::deque<Batch *>::iterator it = std::find(queue.begin(), queue.end(), pBatch);
+        if (it != queue.end())
+            queue.erase(it);
+    }
+
+    lock.unlock();
+    pBatch->task(pBatch->pData, nTask);
+    lock.lock();
+
+    if (++pBatch->nDone == pBatch->nTasks)
+        done.notify_all();
+
+    return true;
+}
+
+
+void DeCrossThreadPool::work() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        if (runOne(lock, NULL))
+            continue;
+
+        if (bQuit)
+            return;
+
+        wake.wait(lock);
+    }
+}
+
+
+void DeCrossThreadPool::run(DeCrossTaskFunction task, void *pData, int nTasks) {
+    Batch batch = { task, pData, nTasks, 0, 0 };
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (nTasks > 1 && !workers.empty()) {
+        queue.push_back(&batch);
+        wake.notify_all();
+    }
+
+    while (runOne(lock, &batch))
+        ;
+
+    while (batch.nDone < batch.nTasks)
+        done.wait(lock);
+}
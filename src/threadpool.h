@@ -0,0 +1,46 @@
+#ifndef DECROSS_THREADPOOL_H
+#define DECROSS_THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+typedef void (*DeCrossTaskFunction)(void *pData, int nTask);
+
+
+// A fixed set of worker threads shared by all the frames of one filter
+// instance. Several frames can run tasks at the same time.
+class DeCrossThreadPool {
+public:
+    // Starts nThreads - 1 workers. The thread calling run() is the last one.
+    explicit DeCrossThreadPool(int nThreads);
+    ~DeCrossThreadPool();
+
+    // Calls task(pData, i) for every i from 0 to nTasks - 1, spread over the
+    // workers and the calling thread, and returns when all calls are done.
+    void run(DeCrossTaskFunction task, void *pData, int nTasks);
+
+private:
+    struct Batch {
+        DeCrossTaskFunction task;
+        void *pData;
+        int nTasks;
+        int nNext;
+        int nDone;
+    };
+
+    bool runOne(std::unique_lock<std::mutex> &lock, Batch *pBatch);
+    void work();
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::deque<Batch *> queue;
+    std::vector<std::thread> workers;
+    bool bQuit;
+};
+
+#endif // DECROSS_THREADPOOL_H
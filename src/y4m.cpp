@@ -0,0 +1,645 @@
+// Filters a YUV4MPEG2 stream without VapourSynth, e.g.
+//
+//     ffmpeg -i in.mkv -f yuv4mpegpipe - | decross-y4m | x264 --demuxer y4m -o out.264 -
+//
+// A file is mapped and filtered where it is. From a stream, only the frames
+// being filtered are held, in buffers allocated once. One thread reads the
+// next frame and another writes the last one while the frames in between
+// are filtered.
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#if defined (_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "process.h"
+
+
+// The previous, current and next frames, and the one being read.
+#define Y4M_SLOTS (FRAME_COUNT + 1)
+
+// The chroma of the frame being filtered and of the one being written.
+#define Y4M_OUTPUTS 2
+
+// Longer header lines are taken for garbage.
+#define Y4M_MAX_LINE 4096
+
+
+// Where the frames come from: the whole file mapped in memory if it can
+// be, a stream such as stdin otherwise.
+typedef struct Y4MInput {
+    FILE *pFile;
+    const uint8_t *pMap;
+    size_t nMapSize;
+    size_t nMapPos;
+} Y4MInput;
+
+
+// A frame as it is in the stream, with its planes one after another, in
+// the mapped input or copied to pData.
+typedef struct Y4MSlot {
+    uint8_t *pData; // NULL until a frame is copied
+    const uint8_t *pPlanes[3];
+    std::string header; // the FRAME line, with its parameters
+} Y4MSlot;
+
+
+// The chroma of a frame.
+typedef struct Y4MOutput {
+    uint8_t *pData;
+    uint8_t *pPlanes[2];
+    bool bFiltered; // otherwise the chroma in the slot is written
+} Y4MOutput;
+
+
+typedef struct Y4MStream {
+    DeCrossFilter filter;
+
+    size_t nPlaneSize[3];
+    size_t nFrameSize;
+    int nRowSize[3]; // in bytes
+    int nOutputPitch;
+
+    Y4MInput input;
+    FILE *pOutput;
+
+    Y4MSlot slots[Y4M_SLOTS];
+    Y4MOutput outputs[Y4M_OUTPUTS];
+
+    // Frames [0, nRead) have been read, [0, nFiltered) filtered and
+    // [0, nWritten) written. Frame n is in slots[n % Y4M_SLOTS] and its
+    // chroma in outputs[n % Y4M_OUTPUTS].
+    std::mutex mutex;
+    std::condition_variable changed;
+    int nRead;
+    int nFiltered;
+    int nWritten;
+    bool bEnd; // the input has no frames after nRead
+    bool bDone; // no frames after nFiltered will be filtered
+    const char *pError; // stops all three threads
+} Y4MStream;
+
+
+static void y4mFail(Y4MStream *s, const char *pError) {
+    std::lock_guard<std::mutex> guard(s->mutex);
+
+    if (!s->pError)
+        s->pError = pError;
+
+    s->changed.notify_all();
+}
+
+
+static bool y4mOpenInput(Y4MInput *input, const char *pPath) {
+    memset(input, 0, sizeof(Y4MInput));
+
+    if (!strcmp(pPath, "-")) {
+#if defined (_WIN32)
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        input->pFile = stdin;
+        return true;
+    }
+
+#if !defined (_WIN32)
+    // Pipes and empty files can't be mapped and are read as streams.
+    int fd = open(pPath, O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+
+        if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void *pMap = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (pMap != MAP_FAILED) {
+                madvise(pMap, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+                input->pMap = (const uint8_t *)pMap;
+                input->nMapSize = (size_t)st.st_size;
+            }
+        }
+
+        close(fd);
+
+        if (input->pMap)
+            return true;
+    }
+#endif
+
+    input->pFile = fopen(pPath, "rb");
+
+    return input->pFile != NULL;
+}
+
+
+static void y4mCloseInput(Y4MInput *input) {
+#if !defined (_WIN32)
+    if (input->pMap)
+        munmap((void *)input->pMap, input->nMapSize);
+#endif
+
+    if (input->pFile && input->pFile != stdin)
+        fclose(input->pFile);
+}
+
+
+// Reads up to the next newline, which is left out. Returns false at the
+// end of the input or if the line is too long.
+static bool y4mReadLine(Y4MInput *input, std::string *pLine) {
+    pLine->clear();
+
+    if (input->pMap) {
+        const uint8_t *pStart = input->pMap + input->nMapPos;
+        const size_t nLeft = input->nMapSize - input->nMapPos;
+        const uint8_t *pEnd = (const uint8_t *)memchr(pStart, '\n', std::min(nLeft, (size_t)Y4M_MAX_LINE));
+
+        if (!pEnd)
+            return false;
+
+        pLine->assign((const char *)pStart, pEnd - pStart);
+        input->nMapPos += pEnd - pStart + 1;
+
+        return true;
+    }
+
+    int c;
+
+    while ((c = getc(input->pFile)) != '\n') {
+        if (c == EOF || pLine->size() == Y4M_MAX_LINE)
+            return false;
+
+        pLine->push_back((char)c);
+    }
+
+    return true;
+}
+
+
+static bool y4mAtEnd(Y4MInput *input) {
+    if (input->pMap)
+        return input->nMapPos == input->nMapSize;
+
+    int c = getc(input->pFile);
+    if (c == EOF)
+        return true;
+
+    ungetc(c, input->pFile);
+
+    return false;
+}
+
+
+// Sets the dimensions and the format of filter from the stream header.
+// Returns the message to report if the stream can't be filtered, or NULL.
+static const char *y4mParseHeader(const std::string &header, DeCrossFilter *filter) {
+    if (header.compare(0, 10, "YUV4MPEG2 ") && header != "YUV4MPEG2")
+        return "The input is not a YUV4MPEG2 stream.";
+
+    // The default when there is no C parameter.
+    std::string colorSpace = "420jpeg";
+
+    size_t nPos = 9;
+
+    while (nPos < header.size()) {
+        size_t nEnd = header.find(' ', nPos + 1);
+        if (nEnd == std::string::npos)
+            nEnd = header.size();
+
+        const std::string param = header.substr(nPos + 1, nEnd - nPos - 1);
+
+        if (!param.empty() && param[0] == 'W')
+            filter->nWidth = atoi(param.c_str() + 1);
+        else if (!param.empty() && param[0] == 'H')
+            filter->nHeight = atoi(param.c_str() + 1);
+        else if (!param.empty() && param[0] == 'C')
+            colorSpace = param.substr(1);
+
+        nPos = nEnd;
+    }
+
+    const std::string subsampling = colorSpace.substr(0, 3);
+    const std::string depth = colorSpace.substr(std::min(colorSpace.size(), (size_t)3));
+
+    filter->subSamplingW = subsampling == "444" ? 0 : subsampling == "411" ? 2 : 1;
+    filter->subSamplingH = subsampling == "420";
+    filter->nBitsPerSample = 8;
+
+    if (depth.size() > 1 && depth[0] == 'p')
+        filter->nBitsPerSample = atoi(depth.c_str() + 1);
+    else if (!depth.empty() && depth != "jpeg" && depth != "paldv" && depth != "mpeg2")
+        filter->nBitsPerSample = 0;
+
+    if ((subsampling != "444" && subsampling != "422" && subsampling != "420" && subsampling != "411") ||
+        filter->nBitsPerSample < 8 || filter->nBitsPerSample > 16)
+        return "Only 4:4:4, 4:2:2, 4:2:0 and 4:1:1 with 8 to 16 bits per sample are supported.";
+
+#if defined (__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    if (filter->nBitsPerSample > 8)
+        return "More than 8 bits per sample need a little endian CPU.";
+#endif
+
+    if (filter->nWidth <= 0 || filter->nHeight <= 0 ||
+        filter->nWidth % (1 << filter->subSamplingW) || filter->nHeight % (1 << filter->subSamplingH))
+        return "The dimensions must be positive and a multiple of the chroma subsampling.";
+
+    return NULL;
+}
+
+
+static void y4mAllocate(Y4MStream *s) {
+    const DeCrossFilter *d = &s->filter;
+    const int nBytes = d->nBitsPerSample > 8 ? 2 : 1;
+    const int nHeightU = d->nHeight >> d->subSamplingH;
+
+    s->nRowSize[0] = d->nWidth * nBytes;
+    s->nRowSize[1] = s->nRowSize[2] = (d->nWidth >> d->subSamplingW) * nBytes;
+    s->nPlaneSize[0] = (size_t)s->nRowSize[0] * d->nHeight;
+    s->nPlaneSize[1] = s->nPlaneSize[2] = (size_t)s->nRowSize[1] * nHeightU;
+    s->nFrameSize = s->nPlaneSize[0] + s->nPlaneSize[1] + s->nPlaneSize[2];
+
+    // Frames are copied only from a stream, or when they can't be used
+    // where they are mapped.
+    for (int i = 0; i < Y4M_SLOTS; i++)
+        s->slots[i].pData = s->input.pMap ? NULL : (uint8_t *)malloc(s->nFrameSize);
+
+    // The filtered rows are written one by one, so they can be aligned
+    // like in a VapourSynth frame.
+    s->nOutputPitch = (s->nRowSize[1] + 63) & ~63;
+
+    const size_t nOutputSize = (size_t)s->nOutputPitch * nHeightU;
+
+    for (int i = 0; i < Y4M_OUTPUTS; i++) {
+        Y4MOutput *output = &s->outputs[i];
+
+        output->pData = (uint8_t *)calloc(2 * nOutputSize, 1);
+        output->pPlanes[0] = output->pData;
+        output->pPlanes[1] = output->pPlanes[0] + nOutputSize;
+    }
+}
+
+
+static void y4mFree(Y4MStream *s) {
+    for (int i = 0; i < Y4M_SLOTS; i++)
+        free(s->slots[i].pData);
+
+    for (int i = 0; i < Y4M_OUTPUTS; i++)
+        free(s->outputs[i].pData);
+}
+
+
+// Points the slot's planes at the next frame of the input. A mapped frame
+// is used where it is, with the rows one after another, unless its samples
+// above 8 bits are at odd addresses; a frame from a stream is copied.
+static bool y4mReadFrame(Y4MStream *s, Y4MSlot *slot) {
+    Y4MInput *input = &s->input;
+    const uint8_t *pFrame;
+
+    if (input->pMap) {
+        if (input->nMapSize - input->nMapPos < s->nFrameSize)
+            return false;
+
+        pFrame = input->pMap + input->nMapPos;
+        input->nMapPos += s->nFrameSize;
+
+        if (s->filter.nBitsPerSample > 8 && ((uintptr_t)pFrame & 1)) {
+            if (!slot->pData)
+                slot->pData = (uint8_t *)malloc(s->nFrameSize);
+
+            memcpy(slot->pData, pFrame, s->nFrameSize);
+            pFrame = slot->pData;
+        }
+    } else {
+        if (fread(slot->pData, 1, s->nFrameSize, input->pFile) != s->nFrameSize)
+            return false;
+
+        pFrame = slot->pData;
+    }
+
+    slot->pPlanes[0] = pFrame;
+    slot->pPlanes[1] = slot->pPlanes[0] + s->nPlaneSize[0];
+    slot->pPlanes[2] = slot->pPlanes[1] + s->nPlaneSize[1];
+
+    return true;
+}
+
+
+static void y4mReadFrames(Y4MStream *s) {
+    for (int n = 0; ; n++) {
+        {
+            // The slot's last frame must have been written and must not
+            // be needed by the frame after it anymore.
+            std::unique_lock<std::mutex> lock(s->mutex);
+
+            while (!s->pError && (s->nFiltered < n - Y4M_SLOTS + 2 || s->nWritten < n - Y4M_SLOTS + 1))
+                s->changed.wait(lock);
+
+            if (s->pError)
+                return;
+        }
+
+        Y4MSlot *slot = &s->slots[n % Y4M_SLOTS];
+
+        if (y4mAtEnd(&s->input)) {
+            std::lock_guard<std::mutex> guard(s->mutex);
+            s->bEnd = true;
+            s->changed.notify_all();
+            return;
+        }
+
+        if (!y4mReadLine(&s->input, &slot->header) || slot->header.compare(0, 5, "FRAME")) {
+            y4mFail(s, "Expected a FRAME line in the input.");
+            return;
+        }
+
+        if (!y4mReadFrame(s, slot)) {
+            y4mFail(s, "The input ends in the middle of a frame.");
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(s->mutex);
+        s->nRead = n + 1;
+        s->changed.notify_all();
+    }
+}
+
+
+static bool y4mWriteFrame(Y4MStream *s, const Y4MSlot *slot, const Y4MOutput *output) {
+    FILE *pFile = s->pOutput;
+
+    if (fwrite(slot->header.data(), 1, slot->header.size(), pFile) != slot->header.size() || putc('\n', pFile) == EOF)
+        return false;
+
+    if (fwrite(slot->pPlanes[0], 1, s->nPlaneSize[0], pFile) != s->nPlaneSize[0])
+        return false;
+
+    if (!output->bFiltered)
+        return fwrite(slot->pPlanes[1], 1, s->nPlaneSize[1] + s->nPlaneSize[2], pFile) == s->nPlaneSize[1] + s->nPlaneSize[2];
+
+    const int nHeightU = s->filter.nHeight >> s->filter.subSamplingH;
+
+    for (int p = 0; p < 2; p++)
+        for (int y = 0; y < nHeightU; y++)
+            if (fwrite(output->pPlanes[p] + y * s->nOutputPitch, 1, s->nRowSize[1], pFile) != (size_t)s->nRowSize[1])
+                return false;
+
+    return true;
+}
+
+
+static void y4mWriteFrames(Y4MStream *s) {
+    for (int n = 0; ; n++) {
+        {
+            std::unique_lock<std::mutex> lock(s->mutex);
+
+            while (!s->pError && !s->bDone && s->nFiltered <= n)
+                s->changed.wait(lock);
+
+            if (s->pError || s->nFiltered <= n)
+                return;
+        }
+
+        if (!y4mWriteFrame(s, &s->slots[n % Y4M_SLOTS], &s->outputs[n % Y4M_OUTPUTS])) {
+            y4mFail(s, "Failed to write the output.");
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(s->mutex);
+        s->nWritten = n + 1;
+        s->changed.notify_all();
+    }
+}
+
+
+// Like the plugin, the first and last frames are returned unfiltered if
+// the neighbours are searched. A stream has no scene changes.
+static void y4mFilterFrames(Y4MStream *s) {
+    for (int n = 0; ; n++) {
+        bool bLast;
+
+        {
+            std::unique_lock<std::mutex> lock(s->mutex);
+
+            while (!s->pError && ((!s->bEnd && s->nRead < n + 2) || s->nWritten < n - Y4M_OUTPUTS + 1))
+                s->changed.wait(lock);
+
+            if (s->pError || s->nRead <= n)
+                break;
+
+            bLast = s->nRead == n + 1;
+        }
+
+        Y4MOutput *output = &s->outputs[n % Y4M_OUTPUTS];
+        output->bFiltered = !s->filter.bNeighbours || (n > 0 && !bLast);
+
+        if (output->bFiltered) {
+            DeCrossPlanes planes;
+            memset(&planes, 0, sizeof(planes));
+
+            for (int fr = 0; fr < FRAME_COUNT; fr++) {
+                const Y4MSlot *slot = &s->slots[(s->filter.bNeighbours ? n - 1 + fr : n) % Y4M_SLOTS];
+
+                planes.pSrc[fr] = slot->pPlanes[0];
+                planes.pSrcU[fr] = slot->pPlanes[1];
+                planes.pSrcV[fr] = slot->pPlanes[2];
+            }
+
+            planes.nNeighbours = s->filter.bNeighbours ? DECROSS_NEIGHBOURS_BOTH : DECROSS_NEIGHBOURS_NONE;
+            planes.nSrcPitch = s->nRowSize[0];
+            planes.nSrcPitchU = s->nRowSize[1];
+            planes.pDstU = output->pPlanes[0];
+            planes.pDstV = output->pPlanes[1];
+            planes.nDstPitchU = s->nOutputPitch;
+
+            deCrossProcessFrame(&s->filter, &planes, NULL);
+        }
+
+        std::lock_guard<std::mutex> guard(s->mutex);
+        s->nFiltered = n + 1;
+        s->changed.notify_all();
+    }
+
+    std::lock_guard<std::mutex> guard(s->mutex);
+    s->bDone = true;
+    s->changed.notify_all();
+}
+
+
+static void usage() {
+    fprintf(stderr,
+            "Usage: decross-y4m [options] [INPUT [OUTPUT]]\n"
+            "\n"
+            "Filters a YUV4MPEG2 stream, 4:4:4, 4:2:2, 4:2:0 or 4:1:1 with 8 to 16 bits per sample.\n"
+            "INPUT and OUTPUT are stdin and stdout if left out or -.\n"
+            "\n"
+            "  --thresholdy N        (default: 30)\n"
+            "  --noise N             (default: 60)\n"
+            "  --margin N            (default: 1)\n"
+            "  --debug               Show the areas that would be filtered instead\n"
+            "  --opt N               Highest instruction set, 0 to 3 (default: 3)\n"
+            "  --threads N           Threads filtering each frame, 0 for one per CPU core (default: 0)\n"
+            "  --search MODE         full, fast, spatial or temporal (default: full)\n"
+            "  --crop L,T,R,B        Luma pixels left out on each side (default: 0,0,0,0)\n"
+            "  --autocrop            Leave out the black borders of each frame too\n");
+}
+
+
+int main(int argc, char **argv) {
+    Y4MStream s;
+    memset(&s.filter, 0, sizeof(s.filter));
+
+    s.filter.nYThreshold = 30;
+    s.filter.nNoiseThreshold = 60;
+    s.filter.nMargin = 1;
+    s.filter.nThreads = 0;
+
+    int opt = DECROSS_OPT_AVX512;
+    const char *search = "full";
+    const char *pPaths[2] = { "-", "-" };
+    int nPaths = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *pArg = argv[i];
+        const char *pValue = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (pArg[0] != '-' || !strcmp(pArg, "-")) {
+            if (nPaths == 2) {
+                usage();
+                return 1;
+            }
+
+            pPaths[nPaths++] = pArg;
+            continue;
+        }
+
+        if (!strcmp(pArg, "--debug")) {
+            s.filter.bDebug = true;
+            continue;
+        }
+
+        if (!strcmp(pArg, "--autocrop")) {
+            s.filter.bAutoCrop = true;
+            continue;
+        }
+
+        if (!pValue) {
+            usage();
+            return 1;
+        }
+
+        i++;
+
+        int l, t, r, b;
+
+        if (!strcmp(pArg, "--thresholdy")) {
+            s.filter.nYThreshold = atoi(pValue);
+        } else if (!strcmp(pArg, "--noise")) {
+            s.filter.nNoiseThreshold = atoi(pValue);
+        } else if (!strcmp(pArg, "--margin")) {
+            s.filter.nMargin = atoi(pValue);
+        } else if (!strcmp(pArg, "--opt")) {
+            opt = atoi(pValue);
+        } else if (!strcmp(pArg, "--threads")) {
+            s.filter.nThreads = atoi(pValue);
+        } else if (!strcmp(pArg, "--search")) {
+            search = pValue;
+        } else if (!strcmp(pArg, "--crop") && sscanf(pValue, "%d,%d,%d,%d", &l, &t, &r, &b) == 4) {
+            s.filter.nLeft = l;
+            s.filter.nTop = t;
+            s.filter.nRight = r;
+            s.filter.nBottom = b;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    const char *pError = deCrossCheckParams(&s.filter, opt, search);
+    if (pError) {
+        fprintf(stderr, "%s\n", pError);
+        return 1;
+    }
+
+    if (!y4mOpenInput(&s.input, pPaths[0])) {
+        fprintf(stderr, "Failed to open '%s'.\n", pPaths[0]);
+        return 1;
+    }
+
+    std::string header;
+
+    if (!y4mReadLine(&s.input, &header))
+        pError = "The input is not a YUV4MPEG2 stream.";
+    else
+        pError = y4mParseHeader(header, &s.filter);
+
+    if (pError) {
+        fprintf(stderr, "%s\n", pError);
+        y4mCloseInput(&s.input);
+        return 1;
+    }
+
+    if (!strcmp(pPaths[1], "-")) {
+#if defined (_WIN32)
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        s.pOutput = stdout;
+    } else {
+        s.pOutput = fopen(pPaths[1], "wb");
+
+        if (!s.pOutput) {
+            fprintf(stderr, "Failed to open '%s'.\n", pPaths[1]);
+            y4mCloseInput(&s.input);
+            return 1;
+        }
+    }
+
+    deCrossInitFilter(&s.filter, opt);
+    y4mAllocate(&s);
+
+    s.nRead = 0;
+    s.nFiltered = 0;
+    s.nWritten = 0;
+    s.bEnd = false;
+    s.bDone = false;
+    s.pError = NULL;
+
+    // The header is passed on unchanged.
+    if (fwrite(header.data(), 1, header.size(), s.pOutput) != header.size() || putc('\n', s.pOutput) == EOF)
+        s.pError = "Failed to write the output.";
+
+    std::thread reader(y4mReadFrames, &s);
+    std::thread writer(y4mWriteFrames, &s);
+
+    y4mFilterFrames(&s);
+
+    writer.join();
+    reader.join();
+
+    if (!s.pError && fflush(s.pOutput))
+        s.pError = "Failed to write the output.";
+
+    if (s.pError)
+        fprintf(stderr, "%s\n", s.pError);
+
+    if (s.pOutput != stdout)
+        fclose(s.pOutput);
+
+    y4mCloseInput(&s.input);
+    y4mFree(&s);
+    deCrossFreeFilter(&s.filter);
+
+    return s.pError ? 1 : 0;
+}